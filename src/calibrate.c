@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Calibration (Option "Calibration" and the "TUIO Calibration" property).
+ * A 3x3 homography maps TUIO coordinates to device coordinates, which
+ * covers keystone correction of projector tables as well as rotation and
+ * mapping to a part of the screen.  The matrix is converted to 16.16
+ * fixed point when it is set, so that transforming a position is a few
+ * integer multiplies and one divide, with no branches but the clamping.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+/* Coefficients larger than this could overflow the transform */
+#define MAX_COEFFICIENT 1024.0f
+
+/* 1 in the 0.31 fixed point of positions */
+#define ONE (1LL << 31)
+
+static const float identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+/**
+ * Validates a row-major matrix and precomputes it into cal
+ *
+ * @return False if the matrix is singular, does not map the origin to a
+ * finite point, or has coefficients out of range
+ */
+Bool
+TuioCalibrationSet(CalibrationPtr cal, const float *matrix)
+{
+    float det, scale;
+    int i;
+
+    det = matrix[0] * (matrix[4] * matrix[8] - matrix[5] * matrix[7]) -
+          matrix[1] * (matrix[3] * matrix[8] - matrix[5] * matrix[6]) +
+          matrix[2] * (matrix[3] * matrix[7] - matrix[4] * matrix[6]);
+    if (!isfinite(det) || det == 0.0f || matrix[8] == 0.0f)
+        return False;
+
+    /* Scale the matrix so that the last coefficient is 1 */
+    scale = 1.0f / matrix[8];
+    for (i = 0; i < 9; i++) {
+        if (!(fabsf(matrix[i] * scale) < MAX_COEFFICIENT))
+            return False;
+    }
+
+    for (i = 0; i < 9; i++) {
+        cal->matrix[i] = matrix[i];
+        cal->coeff[i] = lrintf(matrix[i] * scale * 65536.0f);
+    }
+    cal->identity = memcmp(matrix, identity, sizeof(identity)) == 0;
+
+    return True;
+}
+
+/**
+ * Reads Option "Calibration", nine numbers in row-major order, into
+ * pTuio->calibration.  Without the option, or if it is not valid, TUIO
+ * coordinates are used as they are.
+ */
+void
+TuioCalibrationInit(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    float m[9];
+    char *str;
+
+    TuioCalibrationSet(&pTuio->calibration, identity);
+
+    str = xf86SetStrOption(pInfo->options, "Calibration", NULL);
+    if (str == NULL)
+        return;
+
+    if (sscanf(str, "%f %f %f %f %f %f %f %f %f", &m[0], &m[1], &m[2],
+               &m[3], &m[4], &m[5], &m[6], &m[7], &m[8]) != 9 ||
+        !TuioCalibrationSet(&pTuio->calibration, m))
+        xf86Msg(X_ERROR, "%s: Calibration \"%s\" is not a valid 3x3 "
+                "matrix, ignoring\n", pInfo->name, str);
+    else if (!pTuio->calibration.identity)
+        xf86Msg(X_INFO, "%s: Calibration matrix set\n", pInfo->name);
+    free(str);
+}
+
+static inline int
+_clamp_valuator(long long value)
+{
+    return value < 0 ? 0 : value > 0x7FFFFFFF ? 0x7FFFFFFF : value;
+}
+
+/**
+ * @return a coordinate clamped to [0, 1], 0 if it is NaN
+ */
+static inline float
+_clamp_unit(float value)
+{
+    return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+}
+
+/**
+ * Transforms a position in TUIO coordinates into the x and y valuators.
+ * Positions outside of [0, 1] are clamped first, which also keeps the
+ * fixed point products in range.
+ */
+void
+TuioCalibrate(CalibrationPtr cal, float x, float y, int *valuators)
+{
+    const long long *c = cal->coeff;
+    long long vx, vy, w;
+
+    x = _clamp_unit(x);
+    y = _clamp_unit(y);
+    vx = x * 0x7FFFFFFF;
+    vy = y * 0x7FFFFFFF;
+    if (cal->identity) {
+        /* 1 rounds up to 2^31 in single precision */
+        valuators[0] = _clamp_valuator(vx);
+        valuators[1] = _clamp_valuator(vy);
+        return;
+    }
+
+    /* Numerators in 16.47 fixed point, w in 16.16, so the quotients
+     * come out in valuator units */
+    w = (c[6] * vx + c[7] * vy + c[8] * ONE) >> 31;
+    if (w <= 0) /* On or behind the horizon of the projection */
+        w = 1;
+    valuators[0] = _clamp_valuator((c[0] * vx + c[1] * vy + c[2] * ONE) / w);
+    valuators[1] = _clamp_valuator((c[3] * vx + c[4] * vy + c[5] * ONE) / w);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Jitter filtering (Option "FilterMinCutoff").  Each object runs a One
+ * Euro filter: a low-pass filter whose cutoff frequency rises with the
+ * speed of the object, so that a resting touch is smoothed heavily while
+ * a moving one follows with little lag.  The filter works on the
+ * position to be posted, before prediction.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+#define FILTER_MIN_DT 0.001f /* s, for updates with the same time */
+
+/**
+ * @return the smoothing factor of a low-pass filter with cutoff
+ * frequency cutoff, for a sample dt seconds after the last
+ */
+static inline float
+_filter_alpha(float cutoff, float dt)
+{
+    float tau = 1.0f / (2 * M_PI * cutoff);
+
+    return 1.0f / (1.0f + tau / dt);
+}
+
+/**
+ * Filters the position to be posted for an object
+ */
+void
+TuioFilterUpdate(TuioDevicePtr pTuio, ObjectPtr obj)
+{
+    FilterPtr f = &obj->filter;
+    float dt, a, cutoff;
+
+    if (!f->primed) {
+        f->primed = True;
+        f->time = obj->time;
+        f->x = obj->post_x;
+        f->y = obj->post_y;
+        f->dx = 0.0f;
+        f->dy = 0.0f;
+        return;
+    }
+
+    dt = obj->time > f->time ? (obj->time - f->time) / 1e9f : 0.0f;
+    if (dt < FILTER_MIN_DT)
+        dt = FILTER_MIN_DT;
+    f->time = obj->time;
+
+    /* The speed, itself filtered at a fixed cutoff, sets the cutoff for
+     * the position */
+    a = _filter_alpha(FILTER_DERIVATIVE_CUTOFF, dt);
+    f->dx += a * ((obj->post_x - f->x) / dt - f->dx);
+    f->dy += a * ((obj->post_y - f->y) / dt - f->dy);
+    cutoff = pTuio->filter_min_cutoff +
+        pTuio->filter_beta * hypotf(f->dx, f->dy);
+
+    a = _filter_alpha(cutoff, dt);
+    f->x += a * (obj->post_x - f->x);
+    f->y += a * (obj->post_y - f->y);
+
+    obj->post_x = f->x;
+    obj->post_y = f->y;
+}
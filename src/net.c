@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Socket handling.  Datagrams are received into a ring of preallocated
+ * buffers, up to ReceiveBatch of them per receive call, and then handed
+ * to whichever decoder is in use.  Each datagram is stamped with the time
+ * the kernel received it, so that bursts delivered in one wakeup still
+ * carry their actual spacing.  Along with it comes the number of
+ * datagrams the socket has dropped so far, which tells loss in the
+ * receive buffer apart from loss on the network.
+ *
+ * Instead of UDP, a tracker on the same machine can send the same
+ * datagrams to a Unix datagram socket (Option "SocketPath"), which keeps
+ * them out of the IP stack.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <grp.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <xf86Xinput.h>
+#include <xf86_OSlib.h>
+
+#include "tuio.h"
+
+/**
+ * Allocates the receive ring, recv_batch buffers of OSC_MAX_PACKET bytes
+ *
+ * @return False on allocation failure
+ */
+Bool
+TuioNetInit(TuioDevicePtr pTuio)
+{
+    int i;
+
+    pTuio->recv_buf = malloc(pTuio->recv_batch * OSC_MAX_PACKET);
+    if (pTuio->recv_buf == NULL)
+        return False;
+
+    for (i = 0; i < pTuio->recv_batch; i++) {
+        pTuio->packets[i].data = pTuio->recv_buf + i * OSC_MAX_PACKET;
+        pTuio->packets[i].len = 0;
+#ifdef HAVE_RECVMMSG
+        pTuio->recv_iov[i].iov_base = pTuio->packets[i].data;
+        pTuio->recv_iov[i].iov_len = OSC_MAX_PACKET;
+        memset(&pTuio->recv_msgs[i], 0, sizeof(pTuio->recv_msgs[i]));
+        pTuio->recv_msgs[i].msg_hdr.msg_iov = &pTuio->recv_iov[i];
+        pTuio->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+        pTuio->recv_msgs[i].msg_hdr.msg_name = &pTuio->packets[i].addr;
+#ifdef NET_CONTROL
+        pTuio->recv_msgs[i].msg_hdr.msg_control =
+            pTuio->packets[i].control.buf;
+#endif
+#endif
+    }
+
+    return True;
+}
+
+/**
+ * Sets up a bound socket for receiving: asks the kernel to timestamp
+ * datagrams and to report how many it dropped, sizes the receive buffer
+ * and restricts the socket to ListenInterface.  Anything that isn't
+ * available is logged and done without.  Without timestamps, datagrams
+ * are stamped with the time they were read.
+ */
+void
+TuioNetSetup(InputInfoPtr pInfo, int fd)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    int on = 1, size;
+    socklen_t len;
+
+#ifdef SO_TIMESTAMPNS
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+#endif
+        xf86Msg(X_WARNING, "%s: Kernel receive timestamps not available\n",
+                pInfo->name);
+
+#ifdef SO_RXQ_OVFL
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0)
+#endif
+        xf86Msg(X_WARNING, "%s: Kernel drop counts not available\n",
+                pInfo->name);
+
+    if (pTuio->recv_buffer > 0) {
+        /* The kernel doubles the size asked for, to allow for its
+         * bookkeeping.  Only a privileged server may exceed rmem_max. */
+        size = pTuio->recv_buffer / 2;
+#ifdef SO_RCVBUFFORCE
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+                       sizeof(size)) < 0)
+#endif
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+        len = sizeof(size);
+        if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len) == 0 &&
+            size < pTuio->recv_buffer)
+            xf86Msg(X_WARNING, "%s: ReceiveBuffer limited to %i bytes, "
+                    "see net.core.rmem_max\n", pInfo->name, size);
+    }
+
+    if (pTuio->listen_interface != NULL) {
+#ifdef SO_BINDTODEVICE
+        if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE,
+                       pTuio->listen_interface,
+                       strlen(pTuio->listen_interface) + 1) < 0)
+#endif
+            xf86Msg(X_WARNING, "%s: Failed to restrict to interface %s "
+                    "(%s)\n", pInfo->name, pTuio->listen_interface,
+                    strerror(errno));
+    }
+}
+
+/**
+ * Reads the ancillary data of a received datagram.  The datagram is
+ * stamped with its kernel receive time, converted to CLOCK_MONOTONIC by
+ * offset (CLOCK_REALTIME - CLOCK_MONOTONIC), or with now if there is
+ * none.  Datagrams dropped since the last one was received are counted.
+ */
+static inline void
+_net_control(TuioDevicePtr pTuio, PacketPtr packet, struct msghdr *msg,
+             unsigned long long now, long long offset)
+{
+#ifdef NET_CONTROL
+    struct cmsghdr *cmsg;
+    struct timespec ts;
+    uint32_t drops;
+
+    packet->time = now;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+#ifdef SO_TIMESTAMPNS
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            packet->time = (unsigned long long)ts.tv_sec * 1000000000 +
+                ts.tv_nsec - offset;
+            /* The realtime clock may have been stepped meanwhile */
+            if (packet->time > now)
+                packet->time = now;
+        }
+#endif
+#ifdef SO_RXQ_OVFL
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            /* A running total for the socket, which wraps */
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (drops != pTuio->socket_drops) {
+                TuioCount(pTuio, dropped, drops - pTuio->socket_drops);
+                pTuio->socket_drops = drops;
+            }
+        }
+#endif
+    }
+#else
+    packet->time = now;
+#endif
+}
+
+/**
+ * Receives all pending datagrams that fit in the receive ring without
+ * blocking.  Received datagrams, their senders and receive times are
+ * stored in pTuio->packets.
+ *
+ * @return the number of datagrams received, 0 if none were pending
+ */
+int
+TuioNetReceive(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct timespec rt;
+    unsigned long long now;
+    long long offset;
+    ssize_t len;
+    int n = 0;
+
+    clock_gettime(CLOCK_REALTIME, &rt);
+    now = TuioTime();
+    offset = (long long)rt.tv_sec * 1000000000 + rt.tv_nsec - (long long)now;
+
+#ifdef HAVE_RECVMMSG
+    if (pTuio->recv_batch > 1) {
+        int i;
+
+        for (i = 0; i < pTuio->recv_batch; i++) {
+            pTuio->recv_msgs[i].msg_hdr.msg_namelen =
+                sizeof(pTuio->packets[i].addr);
+#ifdef NET_CONTROL
+            pTuio->recv_msgs[i].msg_hdr.msg_controllen =
+                sizeof(pTuio->packets[i].control.buf);
+#endif
+        }
+
+        pTuio->recv_calls++;
+        n = recvmmsg(pTuio->socket_fd, pTuio->recv_msgs, pTuio->recv_batch,
+                     MSG_DONTWAIT, NULL);
+        if (n <= 0)
+            return 0;
+
+        for (i = 0; i < n; i++) {
+            pTuio->packets[i].len = pTuio->recv_msgs[i].msg_len;
+            pTuio->packets[i].addrlen =
+                pTuio->recv_msgs[i].msg_hdr.msg_namelen;
+            _net_control(pTuio, &pTuio->packets[i],
+                         &pTuio->recv_msgs[i].msg_hdr, now, offset);
+        }
+        TuioCount(pTuio, packets, n);
+
+        return n;
+    }
+#endif
+
+    while (n < pTuio->recv_batch) {
+        PacketPtr packet = &pTuio->packets[n];
+        struct msghdr msg;
+        struct iovec iov;
+
+        iov.iov_base = packet->data;
+        iov.iov_len = OSC_MAX_PACKET;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &packet->addr;
+        msg.msg_namelen = sizeof(packet->addr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+#ifdef NET_CONTROL
+        msg.msg_control = packet->control.buf;
+        msg.msg_controllen = sizeof(packet->control.buf);
+#endif
+
+        pTuio->recv_calls++;
+        len = recvmsg(pTuio->socket_fd, &msg, MSG_DONTWAIT);
+        if (len <= 0)
+            break;
+        packet->len = len;
+        packet->addrlen = msg.msg_namelen;
+        _net_control(pTuio, packet, &msg, now, offset);
+        n++;
+    }
+    TuioCount(pTuio, packets, n);
+
+    return n;
+}
+
+/**
+ * Reads the permissions of the socket at SocketPath, Option "SocketMode"
+ * (octal) and Option "SocketGroup" (a name or number)
+ */
+void
+TuioNetUnixInit(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct group *grp;
+    char *str, *end;
+    long val;
+
+    pTuio->socket_mode = DEFAULT_SOCKET_MODE;
+    str = xf86SetStrOption(pInfo->options, "SocketMode", NULL);
+    if (str != NULL) {
+        val = strtol(str, &end, 8);
+        if (*str == '\0' || *end != '\0' || val < 0 || val > 0777)
+            xf86Msg(X_WARNING, "%s: Invalid SocketMode (%s), defaulting "
+                    "to %04o\n", pInfo->name, str, DEFAULT_SOCKET_MODE);
+        else
+            pTuio->socket_mode = val;
+        free(str);
+    }
+
+    pTuio->socket_group = (gid_t)-1;
+    str = xf86SetStrOption(pInfo->options, "SocketGroup", NULL);
+    if (str != NULL) {
+        val = strtol(str, &end, 10);
+        if (*str != '\0' && *end == '\0' && val >= 0) {
+            pTuio->socket_group = val;
+        } else if ((grp = getgrnam(str)) != NULL) {
+            pTuio->socket_group = grp->gr_gid;
+        } else {
+            xf86Msg(X_WARNING, "%s: Unknown SocketGroup (%s), using the "
+                    "server's group\n", pInfo->name, str);
+        }
+        free(str);
+    }
+}
+
+/**
+ * Gets the name of SocketPath in its directory, and into tmp, the name
+ * the socket is bound to until TuioNetPublish() moves it to SocketPath
+ *
+ * @return the name, or NULL if SocketPath has no valid name
+ */
+static const char *
+_net_unix_name(TuioDevicePtr pTuio, char tmp[NAME_MAX + 1])
+{
+    const char *name;
+
+    name = strrchr(pTuio->socket_path, '/');
+    name = name != NULL ? name + 1 : pTuio->socket_path;
+    if (*name == '\0' ||
+        snprintf(tmp, NAME_MAX + 1, ".%s.tmp", name) > NAME_MAX)
+        return NULL;
+    return name;
+}
+
+/**
+ * Opens a non-blocking Unix datagram socket for SocketPath.  Its
+ * directory is opened once and the path is not looked up again.  The
+ * socket is bound under a temporary name in the directory and given its
+ * mode and group there, so that it never appears at SocketPath with
+ * other permissions.
+ *
+ * @return the socket, or -1 on error
+ */
+static int
+_net_open_unix(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct sockaddr_un addr;
+    struct stat st;
+    const char *name;
+    char *dir, tmp[NAME_MAX + 1];
+    int fd;
+
+    name = _net_unix_name(pTuio, tmp);
+    if (name == NULL)
+        goto invalid;
+
+    if (pTuio->socket_dir < 0) {
+        if (name == pTuio->socket_path)
+            dir = strdup(".");
+        else if (name == pTuio->socket_path + 1)
+            dir = strdup("/");
+        else
+            dir = strndup(pTuio->socket_path,
+                          name - 1 - pTuio->socket_path);
+        if (dir == NULL)
+            return -1;
+        pTuio->socket_dir = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (pTuio->socket_dir < 0)
+            xf86Msg(X_ERROR, "%s: Failed to open %s (%s)\n",
+                    pInfo->name, dir, strerror(errno));
+        free(dir);
+        if (pTuio->socket_dir < 0)
+            return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (snprintf(addr.sun_path, sizeof(addr.sun_path), "/proc/self/fd/%i/%s",
+                 pTuio->socket_dir, tmp) >= (int)sizeof(addr.sun_path))
+        goto invalid;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to create socket (%s)\n",
+                pInfo->name, strerror(errno));
+        return -1;
+    }
+
+    /* Only ever remove a socket, here one left by a server that died
+     * before moving it */
+    if (fstatat(pTuio->socket_dir, tmp, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISSOCK(st.st_mode))
+        unlinkat(pTuio->socket_dir, tmp, 0);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to bind to %s (%s)\n",
+                pInfo->name, pTuio->socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (fchmodat(pTuio->socket_dir, tmp, pTuio->socket_mode, 0) < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to set the mode of %s (%s)\n",
+                pInfo->name, pTuio->socket_path, strerror(errno));
+        TuioNetDiscard(pInfo, fd);
+        return -1;
+    }
+    if (pTuio->socket_group != (gid_t)-1 &&
+        fchownat(pTuio->socket_dir, tmp, -1, pTuio->socket_group,
+                 AT_SYMLINK_NOFOLLOW) < 0)
+        xf86Msg(X_WARNING, "%s: Failed to set the group of %s (%s)\n",
+                pInfo->name, pTuio->socket_path, strerror(errno));
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        TuioNetDiscard(pInfo, fd);
+        return -1;
+    }
+
+    return fd;
+
+invalid:
+    xf86Msg(X_ERROR, "%s: Invalid SocketPath %s\n",
+            pInfo->name, pTuio->socket_path);
+    return -1;
+}
+
+/**
+ * Moves the Unix socket last opened by TuioNetOpen() to SocketPath, where
+ * senders find it.  A socket left at SocketPath, by an earlier server or
+ * by the socket being rebound, is replaced; anything else is not.  UDP
+ * sockets are listening as soon as they are opened.
+ *
+ * @return 0, or -1 on error
+ */
+int
+TuioNetPublish(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct stat st;
+    const char *name;
+    char tmp[NAME_MAX + 1];
+
+    if (pTuio->socket_path == NULL)
+        return 0;
+
+    name = _net_unix_name(pTuio, tmp);
+    if (fstatat(pTuio->socket_dir, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        !S_ISSOCK(st.st_mode)) {
+        xf86Msg(X_ERROR, "%s: %s is not a socket\n",
+                pInfo->name, pTuio->socket_path);
+        return -1;
+    }
+    if (fstatat(pTuio->socket_dir, tmp, &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+        renameat(pTuio->socket_dir, tmp, pTuio->socket_dir, name) < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to move the socket to %s (%s)\n",
+                pInfo->name, pTuio->socket_path, strerror(errno));
+        return -1;
+    }
+    /* Remembered so that only this socket is removed */
+    pTuio->socket_ino = st.st_ino;
+
+    return 0;
+}
+
+/**
+ * Closes a socket opened by TuioNetOpen() that TuioNetPublish() has not
+ * moved to SocketPath, and removes it
+ */
+void
+TuioNetDiscard(InputInfoPtr pInfo, int fd)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    char tmp[NAME_MAX + 1];
+
+    close(fd);
+    if (pTuio->socket_path != NULL && pTuio->socket_dir >= 0 &&
+        _net_unix_name(pTuio, tmp) != NULL)
+        unlinkat(pTuio->socket_dir, tmp, 0);
+}
+
+/**
+ * Closes a socket opened by TuioNetOpen().  The socket at SocketPath is
+ * removed, unless something else has taken its place.
+ */
+void
+TuioNetClose(InputInfoPtr pInfo, int fd)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct stat st;
+    const char *name;
+    char tmp[NAME_MAX + 1];
+
+    close(fd);
+    if (pTuio->socket_dir < 0)
+        return;
+
+    name = _net_unix_name(pTuio, tmp);
+    if (fstatat(pTuio->socket_dir, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISSOCK(st.st_mode) && st.st_ino == pTuio->socket_ino)
+        unlinkat(pTuio->socket_dir, name, 0);
+    close(pTuio->socket_dir);
+    pTuio->socket_dir = -1;
+}
+
+/**
+ * Opens a non-blocking UDP socket listening on port, at ListenAddress or
+ * at any IPv4 address.  An unspecified IPv6 address ("::") also receives
+ * from IPv4 senders.  Only with ReusePort may other sockets listen on the
+ * port at the same time, and the kernel spreads senders over them.  With
+ * SocketPath, the Unix socket is opened instead, and only takes
+ * SocketPath with TuioNetPublish().
+ *
+ * @return the socket, or -1 on error
+ */
+int
+TuioNetOpen(InputInfoPtr pInfo, int port)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    struct addrinfo hints, *res;
+    char service[8];
+    int fd, err, on = 1, off = 0;
+
+    if (pTuio->socket_path != NULL)
+        return _net_open_unix(pInfo);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = pTuio->listen_address != NULL ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%i", port);
+
+    err = getaddrinfo(pTuio->listen_address, service, &hints, &res);
+    if (err != 0) {
+        xf86Msg(X_ERROR, "%s: Invalid ListenAddress %s (%s)\n",
+                pInfo->name, pTuio->listen_address, gai_strerror(err));
+        return -1;
+    }
+
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to create socket (%s)\n",
+                pInfo->name, strerror(errno));
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    if (pTuio->reuse_port) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+#endif
+            xf86Msg(X_WARNING, "%s: Failed to set SO_REUSEPORT (%s)\n",
+                    pInfo->name, strerror(errno));
+    }
+
+    if (res->ai_family == AF_INET6 &&
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0)
+        xf86Msg(X_WARNING, "%s: IPv4 senders not received (%s)\n",
+                pInfo->name, strerror(errno));
+
+    if (bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to bind to UDP port %i (%s)\n",
+                pInfo->name, port, strerror(errno));
+        freeaddrinfo(res);
+        close(fd);
+        return -1;
+    }
+    freeaddrinfo(res);
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
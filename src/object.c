@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Table of live objects.  Lookups happen for every "set" message, so
+ * objects are found through an open-addressed hash table rather than by
+ * walking a list, and the table never holds more than half its slots so
+ * probe sequences stay short.  Deletion shifts the rest of a probe
+ * sequence back instead of leaving tombstones, so a long running device
+ * doesn't slow down as contacts come and go.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+/**
+ * Hashes a source and session id into the object table.  Session ids are
+ * usually handed out sequentially, so spread them with a multiplicative
+ * hash and keep its high bits, which depend on every bit of the key.  The
+ * source is scrambled first so that the same id from two sources lands
+ * in different slots.
+ */
+static inline unsigned int
+_object_hash(ObjectTablePtr table, int source, int id) {
+    return (((unsigned int)id ^ (unsigned int)source * 0x9E3779B9u) *
+            2654435761u) >> table->shift;
+}
+
+/**
+ * Sets up an empty object table with room for size slots.  size must be
+ * a power of two, and at least 2.
+ *
+ * @return False on allocation failure
+ */
+Bool
+TuioObjectTableInit(ObjectTablePtr table, unsigned int size) {
+    unsigned int bits;
+
+    table->slots = calloc(size, sizeof(ObjectPtr));
+    if (table->slots == NULL)
+        return False;
+
+    table->mask = size - 1;
+    for (bits = 0; (1u << bits) < size; bits++)
+        ;
+    table->shift = 32 - bits;
+    table->count = 0;
+    table->head = table->tail = NULL;
+
+    return True;
+}
+
+/**
+ * Frees the table storage.  The objects themselves belong to the
+ * object pool.
+ */
+void
+TuioObjectTableFree(ObjectTablePtr table) {
+    free(table->slots);
+    table->slots = NULL;
+    table->head = table->tail = NULL;
+    table->count = 0;
+}
+
+/**
+ * Retrieves an object from the table based on its source and id.
+ *
+ * @return NULL if not found.
+ */
+ObjectPtr
+TuioObjectGet(ObjectTablePtr table, int source, int id) {
+    unsigned int i = _object_hash(table, source, id);
+    ObjectPtr obj;
+
+    while ((obj = table->slots[i]) != NULL) {
+        if (obj->id == id && obj->source == source)
+            return obj;
+        i = (i + 1) & table->mask;
+    }
+
+    return NULL;
+}
+
+/**
+ * Inserts an object into the table and appends it to the end of the
+ * iteration order.  The pool never holds more objects than the table
+ * can take.
+ */
+void
+TuioObjectAdd(ObjectTablePtr table, ObjectPtr obj) {
+    unsigned int i;
+
+    if (table == NULL || obj == NULL)
+        return;
+
+    i = _object_hash(table, obj->source, obj->id);
+    while (table->slots[i] != NULL)
+        i = (i + 1) & table->mask;
+    table->slots[i] = obj;
+    table->count++;
+
+    obj->next = NULL;
+    obj->prev = table->tail;
+    if (table->tail != NULL)
+        table->tail->next = obj;
+    else
+        table->head = obj;
+    table->tail = obj;
+}
+
+/**
+ * Removes an Object from the table.  The rest of the probe sequence is
+ * shifted back so no tombstones are left behind.
+ *
+ * @return the removed object, NULL if not found
+ */
+ObjectPtr
+TuioObjectRemove(ObjectTablePtr table, ObjectPtr obj) {
+    unsigned int i = _object_hash(table, obj->source, obj->id);
+    unsigned int j, home;
+
+    while (table->slots[i] != NULL && table->slots[i] != obj)
+        i = (i + 1) & table->mask;
+
+    if (table->slots[i] == NULL)
+        return NULL;
+
+    /* Backward shift deletion */
+    j = i;
+    for (;;) {
+        table->slots[i] = NULL;
+        do {
+            j = (j + 1) & table->mask;
+            if (table->slots[j] == NULL)
+                goto unlink;
+            home = _object_hash(table, table->slots[j]->source,
+                                table->slots[j]->id);
+        } while (((j - home) & table->mask) < ((j - i) & table->mask));
+        table->slots[i] = table->slots[j];
+        i = j;
+    }
+
+unlink:
+    table->count--;
+
+    if (obj->prev != NULL)
+        obj->prev->next = obj->next;
+    else
+        table->head = obj->next;
+    if (obj->next != NULL)
+        obj->next->prev = obj->prev;
+    else
+        table->tail = obj->prev;
+    obj->next = obj->prev = NULL;
+
+    return obj;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Built-in OSC decoder, used instead of liblo with Option "Decoder" "native".
+ * Received datagrams (see net.c) are walked in place; only the TUIO 1.1
+ * 2Dcur, 2Dobj and 2Dblb and the TUIO 2.0 frm, ptr, tok and alv messages
+ * the driver understands are decoded.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xf86Xinput.h>
+#include <xf86_OSlib.h>
+
+#include "tuio.h"
+
+#define OSC_MAX_DEPTH 4 /* Maximum nesting of bundles */
+
+/* Packs four characters into a big-endian word, for matching padded
+ * OSC strings one word at a time */
+#define OSC_WORD(a, b, c, d) \
+    ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 | (d))
+
+/* Paths and "set" type tags of the TUIO 1.1 profiles, by PROFILE_* */
+static const char *osc_paths[NUM_PROFILES] = {
+    "/tuio/2Dcur", "/tuio/2Dobj", "/tuio/2Dblb"
+};
+static const char *osc_set_types[NUM_PROFILES] = {
+    ",sifffff", ",siiffffffff", ",sifffffffffff"
+};
+
+/**
+ * Reads a big-endian 32 bit word
+ */
+static inline uint32_t
+_osc_word(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline float
+_osc_float(const unsigned char *p)
+{
+    union {
+        uint32_t i;
+        float f;
+    } u;
+
+    u.i = _osc_word(p);
+    return u.f;
+}
+
+/**
+ * Gets the padded size of the OSC string at the start of buf
+ *
+ * @return -1 if the string is not terminated within len bytes
+ */
+static inline int
+_osc_string_size(const unsigned char *buf, int len)
+{
+    const unsigned char *end = memchr(buf, '\0', len);
+    int size;
+
+    if (end == NULL)
+        return -1;
+
+    size = ((end - buf) + 4) & ~3;
+    return size <= len ? size : -1;
+}
+
+/**
+ * Decodes a TUIO 2.0 message.  name is the part of the address after
+ * "/tuio2/" as a word.
+ *
+ * @return -1 if the message is malformed
+ */
+static int
+_osc_decode_tuio2(InputInfoPtr pInfo, uint32_t name,
+                  const unsigned char *types, int len)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    const unsigned char *args;
+    int size, ntypes, i;
+    const char *source;
+    Bool vel;
+
+    size = _osc_string_size(types, len);
+    if (size < 0 || types[0] != ',')
+        return -1;
+    ntypes = strlen((const char *)types) - 1;
+    args = types + size;
+    len -= size;
+
+    switch (name) {
+        case OSC_WORD('f', 'r', 'm', '\0'):
+            /* frm f_id time dim source */
+            if (ntypes < 2 || types[1] != 'i' || types[2] != 't')
+                goto bad_types;
+            if (len < 12)
+                return -1;
+            source = NULL;
+            if (ntypes >= 4 && types[3] == 'i' && types[4] == 's') {
+                if (len < 16 || _osc_string_size(args + 16, len - 16) < 0)
+                    return -1;
+                source = (const char *)args + 16;
+            }
+            TuioFrame(pTuio, _osc_word(args), _osc_word(args + 4),
+                      _osc_word(args + 8), source);
+            break;
+
+        case OSC_WORD('p', 't', 'r', '\0'):
+            /* ptr s_id tu_id c_id x y a shear radius press [X Y P m p] */
+            vel = strcmp((const char *)types, ",iiifffffffffff") == 0;
+            if (!vel && strcmp((const char *)types, ",iiiffffff"))
+                goto bad_types;
+            if (len < ntypes * 4)
+                return -1;
+            TuioPointerSet(pInfo, (int32_t)_osc_word(args),
+                           _osc_float(args + 12), _osc_float(args + 16),
+                           _osc_float(args + 20), _osc_float(args + 24),
+                           _osc_float(args + 28), _osc_float(args + 32),
+                           vel ? _osc_float(args + 36) : 0,
+                           vel ? _osc_float(args + 40) : 0);
+            break;
+
+        case OSC_WORD('t', 'o', 'k', '\0'):
+            /* tok s_id tu_id c_id x y a [X Y A m r] */
+            vel = strcmp((const char *)types, ",iiiffffffff") == 0;
+            if (!vel && strcmp((const char *)types, ",iiifff"))
+                goto bad_types;
+            if (len < ntypes * 4)
+                return -1;
+            TuioTokenSet(pInfo, (int32_t)_osc_word(args),
+                         (int32_t)_osc_word(args + 8),
+                         _osc_float(args + 12), _osc_float(args + 16),
+                         _osc_float(args + 20),
+                         vel ? _osc_float(args + 24) : 0,
+                         vel ? _osc_float(args + 28) : 0);
+            break;
+
+        case OSC_WORD('a', 'l', 'v', '\0'):
+            /* alv s_id0 ... s_idN */
+            for (i = 1; i <= ntypes; i++) {
+                if (types[i] != 'i')
+                    goto bad_types;
+            }
+            if (len < ntypes * 4)
+                return -1;
+            pTuio->alive_seen |= TUIO2_PROFILES;
+            for (i = 0; i < ntypes; i++)
+                TuioAlive(pTuio, (int32_t)_osc_word(args + i * 4));
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+
+bad_types:
+    TuioLogMalformed(pInfo, "Error in /tuio2/%c%c%c msg (types == %s)\n",
+                 name >> 24, (name >> 16) & 0xff, (name >> 8) & 0xff,
+                 types + 1);
+    return 0;
+}
+
+/**
+ * Decodes a single OSC message
+ *
+ * @return -1 if the message is malformed
+ */
+static int
+_osc_decode_message(InputInfoPtr pInfo, const unsigned char *buf, int len)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    const unsigned char *types, *args;
+    int size, ntypes, profile, i;
+
+    size = _osc_string_size(buf, len);
+    if (size < 0)
+        return -1;
+
+    /* Anything but /tuio/2Dcur, /tuio/2Dobj, /tuio/2Dblb and the TUIO 2.0
+     * messages is ignored */
+    if (size != 12)
+        return 0;
+    if (memcmp(buf, "/tuio2/", 7) == 0)
+        return _osc_decode_tuio2(pInfo, _osc_word(buf + 7), buf + size,
+                                 len - size);
+    if (memcmp(buf, "/tuio/2D", 8) != 0)
+        return 0;
+    switch (_osc_word(buf + 8)) {
+        case OSC_WORD('c', 'u', 'r', '\0'):
+            profile = PROFILE_2DCUR;
+            break;
+        case OSC_WORD('o', 'b', 'j', '\0'):
+            profile = PROFILE_2DOBJ;
+            break;
+        case OSC_WORD('b', 'l', 'b', '\0'):
+            profile = PROFILE_2DBLB;
+            break;
+        default:
+            return 0;
+    }
+
+    types = buf + size;
+    len -= size;
+    size = _osc_string_size(types, len);
+    if (size < 0 || types[0] != ',')
+        return -1;
+    ntypes = strlen((const char *)types) - 1;
+    args = types + size;
+    len -= size;
+
+    /* Every message starts with the command string, which is matched
+     * on its first padded word */
+    if (ntypes < 1 || types[1] != 's' || len < 4)
+        return -1;
+
+    /* As with liblo, any command counts the profile as processed, even
+     * one that is ignored or has the wrong types */
+    pTuio->processed |= 1 << profile;
+
+    switch (_osc_word(args)) {
+        case OSC_WORD('s', 'e', 't', '\0'):
+            if (profile == PROFILE_2DCUR) {
+                /* set s x y X Y m */
+                if (ntypes != 7 ||
+                    _osc_word(types) != OSC_WORD(',', 's', 'i', 'f') ||
+                    _osc_word(types + 4) != OSC_WORD('f', 'f', 'f', 'f'))
+                    goto bad_types;
+            } else if (strcmp((const char *)types, osc_set_types[profile])) {
+                goto bad_types;
+            }
+            if (len < ntypes * 4)
+                return -1;
+
+            if (profile == PROFILE_2DCUR) {
+                TuioCursorSet(pInfo, (int32_t)_osc_word(args + 4),
+                              _osc_float(args + 8), _osc_float(args + 12),
+                              _osc_float(args + 16), _osc_float(args + 20));
+            } else if (profile == PROFILE_2DOBJ) {
+                /* set s i x y a X Y A m r */
+                TuioFiducialSet(pInfo, (int32_t)_osc_word(args + 4),
+                                (int32_t)_osc_word(args + 8),
+                                _osc_float(args + 12), _osc_float(args + 16),
+                                _osc_float(args + 20), _osc_float(args + 24),
+                                _osc_float(args + 28));
+            } else {
+                /* set s x y a w h f X Y A m r */
+                TuioBlobSet(pInfo, (int32_t)_osc_word(args + 4),
+                            _osc_float(args + 8), _osc_float(args + 12),
+                            _osc_float(args + 16), _osc_float(args + 20),
+                            _osc_float(args + 24), _osc_float(args + 28),
+                            _osc_float(args + 32), _osc_float(args + 36));
+            }
+            break;
+
+        case OSC_WORD('a', 'l', 'i', 'v'):
+            if (len < 8 || _osc_word(args + 4) != OSC_WORD('e', '\0', '\0', '\0'))
+                return -1;
+            for (i = 2; i <= ntypes; i++) {
+                if (types[i] != 'i')
+                    goto bad_types;
+            }
+            if (len < 8 + (ntypes - 1) * 4)
+                return -1;
+            pTuio->alive_seen |= 1 << profile;
+            for (i = 0; i < ntypes - 1; i++)
+                TuioAlive(pTuio, (int32_t)_osc_word(args + 8 + i * 4));
+            break;
+
+        case OSC_WORD('f', 's', 'e', 'q'):
+            if (len < 8 || _osc_word(args + 4) != 0)
+                return -1;
+            if (ntypes != 2 || types[2] != 'i')
+                goto bad_types;
+            if (len < 12)
+                return -1;
+            pTuio->source->fseq_new[profile] = (int32_t)_osc_word(args + 8);
+            break;
+
+        default:
+            /* Unknown commands (i.e. "source") are ignored */
+            break;
+    }
+
+    return 0;
+
+bad_types:
+    TuioLogMalformed(pInfo, "Error in %s msg (types == %s)\n",
+                 osc_paths[profile], types + 1);
+    return 0;
+}
+
+/**
+ * Decodes an OSC packet, which is either a message or a bundle of
+ * packets
+ *
+ * @return -1 if the packet is malformed
+ */
+static int
+_osc_decode_packet(InputInfoPtr pInfo, const unsigned char *buf, int len,
+                   int depth)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    uint32_t size;
+
+    if (len < 4 || (len & 3))
+        return -1;
+
+    if (buf[0] == '/')
+        return _osc_decode_message(pInfo, buf, len);
+
+    /* "#bundle\0", 64 bit timetag, then size-prefixed elements */
+    if (len < 16 || memcmp(buf, "#bundle", 8) != 0 || depth >= OSC_MAX_DEPTH)
+        return -1;
+
+    /* The outermost bundle times the frame */
+    if (depth == 0)
+        pTuio->timetag = (unsigned long long)_osc_word(buf + 8) << 32 |
+            _osc_word(buf + 12);
+
+    buf += 16;
+    len -= 16;
+    while (len > 0) {
+        if (len < 4)
+            return -1;
+        size = _osc_word(buf);
+        if (size > (uint32_t)len - 4)
+            return -1;
+        if (_osc_decode_packet(pInfo, buf + 4, size, depth + 1) < 0)
+            return -1;
+        buf += 4 + size;
+        len -= 4 + size;
+    }
+
+    return 0;
+}
+
+/**
+ * Decodes a received datagram
+ *
+ * @return -1 if the datagram is malformed
+ */
+int
+TuioOscDecode(InputInfoPtr pInfo, const unsigned char *buf, int len)
+{
+    if (_osc_decode_packet(pInfo, buf, len, 0) < 0) {
+        TuioLogMalformed(pInfo, "Malformed OSC packet (%i bytes)\n", len);
+        return -1;
+    }
+
+    return 0;
+}
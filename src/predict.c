@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Touch position prediction (Option "PredictHorizon"), to make up for the
+ * latency of the tracker and the network.  Each object runs a double
+ * exponential (Holt) filter: a smoothed position, and a smoothed velocity
+ * measured across the last PREDICT_HISTORY positions rather than between
+ * consecutive ones, so that jitter in the timing of single updates
+ * averages out.  Touches are posted at the smoothed position extrapolated
+ * by the horizon.  All state is kept in a fixed-size ring in ObjectRec.
+ *
+ * The filter is fed the position to be posted, after filter.c is done
+ * with it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+static inline float
+_clamp_unit(float value)
+{
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+/**
+ * Feeds the position to be posted for an object to its filter, and
+ * replaces it with where the object will be a horizon from now.  The
+ * filter starts over after a pause of more than MAX_VELOCITY_INTERVAL.
+ */
+void
+TuioPredictUpdate(TuioDevicePtr pTuio, ObjectPtr obj)
+{
+    PredictPtr pr = &obj->predict;
+    float a = pTuio->predict_smoothing;
+    float b = pTuio->predict_trend_smoothing;
+    float dt, span, horizon;
+    int last, oldest;
+
+    last = (pr->head + PREDICT_HISTORY - 1) % PREDICT_HISTORY;
+    if (pr->count > 0 &&
+        (obj->time < pr->time[last] ||
+         obj->time - pr->time[last] > MAX_VELOCITY_INTERVAL)) {
+        pr->head = 0;
+        pr->count = 0;
+    }
+
+    if (pr->count == 0) {
+        pr->level_x = obj->post_x;
+        pr->level_y = obj->post_y;
+        pr->trend_x = 0.0f;
+        pr->trend_y = 0.0f;
+    } else {
+        dt = (obj->time - pr->time[last]) / 1e9f;
+        pr->level_x = a * obj->post_x +
+            (1 - a) * (pr->level_x + pr->trend_x * dt);
+        pr->level_y = a * obj->post_y +
+            (1 - a) * (pr->level_y + pr->trend_y * dt);
+
+        /* Once the ring is full, head is the oldest position */
+        oldest = pr->count < PREDICT_HISTORY ? 0 : pr->head;
+        span = (obj->time - pr->time[oldest]) / 1e9f;
+        if (span > 0.0f) {
+            pr->trend_x = b * (obj->post_x - pr->xpos[oldest]) / span +
+                (1 - b) * pr->trend_x;
+            pr->trend_y = b * (obj->post_y - pr->ypos[oldest]) / span +
+                (1 - b) * pr->trend_y;
+        }
+    }
+
+    pr->time[pr->head] = obj->time;
+    pr->xpos[pr->head] = obj->post_x;
+    pr->ypos[pr->head] = obj->post_y;
+    pr->head = (pr->head + 1) % PREDICT_HISTORY;
+    if (pr->count < PREDICT_HISTORY)
+        pr->count++;
+
+    horizon = pTuio->predict_horizon / 1e9f;
+    obj->post_x = _clamp_unit(pr->level_x + pr->trend_x * horizon);
+    obj->post_y = _clamp_unit(pr->level_y + pr->trend_y * horizon);
+}
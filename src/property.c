@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * XInput device properties of the core device.  The latency and counter
+ * properties are read-only, and are recomputed from TuioDeviceRec each
+ * time a client reads them.  The others mirror options, and changes by
+ * clients are checked and then applied between frames.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <X11/Xatom.h>
+
+#include <xf86Xinput.h>
+#include <exevents.h>
+#include <xserver-properties.h>
+
+#include "tuio.h"
+
+/* Latencies in ns: p50, p99, p999 and the number of datagrams measured */
+#define TUIO_PROP_DECODE_LATENCY "TUIO Decode Latency"
+#define TUIO_PROP_FRAME_LATENCY "TUIO Frame Latency"
+#define NUM_LATENCY_VALUES 4
+
+/* The fields of CountersRec, in order */
+#define TUIO_PROP_COUNTERS "TUIO Counters"
+#define NUM_COUNTER_VALUES (sizeof(CountersRec) / sizeof(unsigned long))
+
+/* 3x3 row-major matrix of floats, see calibrate.c */
+#define TUIO_PROP_CALIBRATION "TUIO Calibration"
+
+/* Options, 32-bit integers unless noted */
+#define TUIO_PROP_PORT "TUIO Port"
+#define TUIO_PROP_FSEQ_THRESHOLD "TUIO Fseq Threshold"
+#define TUIO_PROP_POST_BUTTON_EVENTS "TUIO Post Button Events" /* 8 bit */
+#define TUIO_PROP_PSEUDO_HIDE "TUIO Pseudo Hide" /* 8 bit */
+#define TUIO_PROP_COALESCE_FRAMES "TUIO Coalesce Frames" /* 8 bit */
+#define TUIO_PROP_PREDICT_HORIZON "TUIO Predict Horizon" /* ms */
+#define TUIO_PROP_PREDICT_SMOOTHING "TUIO Predict Smoothing" /* 2 floats */
+#define TUIO_PROP_FILTER "TUIO Filter" /* 2 floats, cutoff and beta */
+#define TUIO_PROP_DEAD_ZONE "TUIO Dead Zone" /* float */
+#define TUIO_PROP_CONTACT_TIMEOUT "TUIO Contact Timeout" /* ms */
+
+static Atom prop_decode_latency;
+static Atom prop_frame_latency;
+static Atom prop_counters;
+static Atom prop_calibration;
+static Atom prop_port;
+static Atom prop_fseq_threshold;
+static Atom prop_post_button_events;
+static Atom prop_pseudo_hide;
+static Atom prop_coalesce_frames;
+static Atom prop_predict_horizon;
+static Atom prop_predict_smoothing;
+static Atom prop_filter;
+static Atom prop_dead_zone;
+static Atom prop_contact_timeout;
+
+static Atom float_type;
+
+/* Set while the driver itself changes a read-only property */
+static Bool updating;
+
+/**
+ * Creates a property with count values, not deletable by clients
+ */
+static Atom
+_property_create(DeviceIntPtr device, const char *name, Atom type,
+                 int format, int count, const void *values)
+{
+    Atom atom = MakeAtom(name, strlen(name), TRUE);
+
+    XIChangeDeviceProperty(device, atom, type, format, PropModeReplace,
+                           count, values, FALSE);
+    XISetDevicePropertyDeletable(device, atom, FALSE);
+
+    return atom;
+}
+
+static inline INT32
+_clamp(unsigned long long value)
+{
+    return value > 0x7FFFFFFF ? 0x7FFFFFFF : value;
+}
+
+/**
+ * Writes the percentiles of a histogram to a read-only property
+ */
+static void
+_property_update_latency(DeviceIntPtr device, Atom atom, HistogramPtr hist)
+{
+    INT32 values[NUM_LATENCY_VALUES];
+    unsigned long total;
+
+    values[0] = _clamp(TuioHistogramPercentile(hist, 0.5, &total));
+    values[1] = _clamp(TuioHistogramPercentile(hist, 0.99, &total));
+    values[2] = _clamp(TuioHistogramPercentile(hist, 0.999, &total));
+    values[3] = _clamp(total);
+
+    updating = True;
+    XIChangeDeviceProperty(device, atom, XA_INTEGER, 32, PropModeReplace,
+                           NUM_LATENCY_VALUES, values, FALSE);
+    updating = False;
+}
+
+/**
+ * Writes a snapshot of the counters to a read-only property.  Counters
+ * wrap around at 2^31.
+ */
+static void
+_property_update_counters(DeviceIntPtr device, Atom atom,
+                          CountersRec *counters)
+{
+    unsigned long *src = (unsigned long *)counters;
+    INT32 values[NUM_COUNTER_VALUES];
+    int i;
+
+    for (i = 0; i < NUM_COUNTER_VALUES; i++)
+        values[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED) & 0x7FFFFFFF;
+
+    updating = True;
+    XIChangeDeviceProperty(device, atom, XA_INTEGER, 32, PropModeReplace,
+                           NUM_COUNTER_VALUES, values, FALSE);
+    updating = False;
+}
+
+/**
+ * Refreshes a property before it is sent to a client
+ */
+static int
+_tuio_get_property(DeviceIntPtr device, Atom atom)
+{
+    InputInfoPtr pInfo = device->public.devicePrivate;
+    TuioDevicePtr pTuio = pInfo->private;
+
+    if (atom == prop_decode_latency)
+        _property_update_latency(device, atom, &pTuio->decode_latency);
+    else if (atom == prop_frame_latency)
+        _property_update_latency(device, atom, &pTuio->frame_latency);
+    else if (atom == prop_counters)
+        _property_update_counters(device, atom, &pTuio->counters);
+
+    return Success;
+}
+
+static inline Bool
+_property_match(XIPropertyValuePtr val, Atom type, int format, int size)
+{
+    return val->type == type && val->format == format && val->size == size;
+}
+
+/**
+ * Checks a new value of a writable property
+ *
+ * @return Success, BadMatch if it has the wrong type, format or number of
+ * values, or BadValue if a value is out of range
+ */
+static int
+_property_check(Atom atom, XIPropertyValuePtr val)
+{
+    INT32 *ints = val->data;
+    CARD8 *bools = val->data;
+    float *floats = val->data;
+    CalibrationRec cal;
+
+    if (atom == prop_port || atom == prop_fseq_threshold ||
+        atom == prop_predict_horizon || atom == prop_contact_timeout) {
+        if (!_property_match(val, XA_INTEGER, 32, 1))
+            return BadMatch;
+        if (ints[0] < 0 ||
+            (atom == prop_port && ints[0] > 65535) ||
+            (atom == prop_predict_horizon && ints[0] > MAX_PREDICT_HORIZON) ||
+            (atom == prop_contact_timeout && ints[0] > MAX_CONTACT_TIMEOUT))
+            return BadValue;
+    } else if (atom == prop_post_button_events || atom == prop_pseudo_hide ||
+               atom == prop_coalesce_frames) {
+        if (!_property_match(val, XA_INTEGER, 8, 1))
+            return BadMatch;
+        if (bools[0] > 1)
+            return BadValue;
+    } else if (atom == prop_predict_smoothing) {
+        if (!_property_match(val, float_type, 32, 2))
+            return BadMatch;
+        if (!(floats[0] > 0 && floats[0] <= 1) ||
+            !(floats[1] > 0 && floats[1] <= 1))
+            return BadValue;
+    } else if (atom == prop_filter) {
+        if (!_property_match(val, float_type, 32, 2))
+            return BadMatch;
+        if (!(floats[0] >= 0) || !(floats[1] >= 0))
+            return BadValue;
+    } else if (atom == prop_dead_zone) {
+        if (!_property_match(val, float_type, 32, 1))
+            return BadMatch;
+        if (!(floats[0] >= 0))
+            return BadValue;
+    } else if (atom == prop_calibration) {
+        if (!_property_match(val, float_type, 32, 9))
+            return BadMatch;
+        if (!TuioCalibrationSet(&cal, floats))
+            return BadValue;
+    }
+
+    return Success;
+}
+
+/**
+ * Applies a checked value of a writable property, other than the port and
+ * the contact timeout
+ */
+static void
+_property_apply(TuioDevicePtr pTuio, Atom atom, XIPropertyValuePtr val)
+{
+    INT32 *ints = val->data;
+    CARD8 *bools = val->data;
+    float *floats = val->data;
+
+    if (atom == prop_fseq_threshold) {
+        pTuio->fseq_threshold = ints[0];
+    } else if (atom == prop_post_button_events) {
+        pTuio->post_button_events = bools[0];
+    } else if (atom == prop_pseudo_hide) {
+        pTuio->hide_devices = bools[0];
+    } else if (atom == prop_coalesce_frames) {
+        pTuio->coalesce = bools[0];
+    } else if (atom == prop_predict_horizon) {
+        pTuio->predict_horizon = ints[0] * 1000000ULL;
+    } else if (atom == prop_predict_smoothing) {
+        pTuio->predict_smoothing = floats[0];
+        pTuio->predict_trend_smoothing = floats[1];
+    } else if (atom == prop_filter) {
+        pTuio->filter_min_cutoff = floats[0];
+        pTuio->filter_beta = floats[1];
+    } else if (atom == prop_dead_zone) {
+        pTuio->dead_zone = floats[0];
+    } else if (atom == prop_calibration) {
+        TuioCalibrationSet(&pTuio->calibration, floats);
+    }
+}
+
+/**
+ * Rejects changes to the read-only properties by clients, and checks and
+ * applies changes to the others.  Changes are applied with frames held
+ * off, by the receive thread or the input handler, so that each frame
+ * sees either the old or the new values.
+ */
+static int
+_tuio_set_property(DeviceIntPtr device, Atom atom, XIPropertyValuePtr val,
+                   BOOL checkonly)
+{
+    InputInfoPtr pInfo = device->public.devicePrivate;
+    TuioDevicePtr pTuio = pInfo->private;
+    int rc, state;
+
+    if (updating)
+        return Success;
+
+    if (atom == prop_decode_latency || atom == prop_frame_latency ||
+        atom == prop_counters)
+        return BadAccess;
+
+    rc = _property_check(atom, val);
+    if (rc != Success)
+        return rc;
+
+    /* Setting the port, even to the same one, moves the listener to a
+     * new socket.  It is opened when the value is checked, as errors
+     * from applying it are ignored. */
+    if (atom == prop_port) {
+        if (checkonly)
+            return TuioRebindPrepare(pInfo, *(INT32 *)val->data);
+        return TuioRebind(pInfo, *(INT32 *)val->data);
+    }
+    if (checkonly)
+        return Success;
+
+    /* The watchdog's timer is set up outside of the thread's lock */
+    if (atom == prop_contact_timeout) {
+        TuioSetContactTimeout(pInfo, *(INT32 *)val->data);
+        return Success;
+    }
+
+    state = TuioLockFrames(pInfo);
+    _property_apply(pTuio, atom, val);
+    TuioUnlockFrames(pInfo, state);
+
+    return Success;
+}
+
+/**
+ * Initialize the device properties
+ */
+void
+TuioPropertyInit(DeviceIntPtr device)
+{
+    InputInfoPtr pInfo = device->public.devicePrivate;
+    TuioDevicePtr pTuio = pInfo->private;
+    INT32 zero[NUM_COUNTER_VALUES] = { 0 };
+    INT32 value;
+    CARD8 flag;
+    float values[2];
+
+    float_type = XIGetKnownProperty(XATOM_FLOAT);
+
+    prop_decode_latency = _property_create(device, TUIO_PROP_DECODE_LATENCY,
+                                           XA_INTEGER, 32,
+                                           NUM_LATENCY_VALUES, zero);
+    prop_frame_latency = _property_create(device, TUIO_PROP_FRAME_LATENCY,
+                                          XA_INTEGER, 32,
+                                          NUM_LATENCY_VALUES, zero);
+    prop_counters = _property_create(device, TUIO_PROP_COUNTERS,
+                                     XA_INTEGER, 32,
+                                     NUM_COUNTER_VALUES, zero);
+    prop_calibration = _property_create(device, TUIO_PROP_CALIBRATION,
+                                        float_type, 32, 9,
+                                        pTuio->calibration.matrix);
+
+    value = pTuio->tuio_port;
+    prop_port = _property_create(device, TUIO_PROP_PORT, XA_INTEGER, 32,
+                                 1, &value);
+    value = pTuio->fseq_threshold;
+    prop_fseq_threshold = _property_create(device, TUIO_PROP_FSEQ_THRESHOLD,
+                                           XA_INTEGER, 32, 1, &value);
+    flag = pTuio->post_button_events;
+    prop_post_button_events = _property_create(device,
+            TUIO_PROP_POST_BUTTON_EVENTS, XA_INTEGER, 8, 1, &flag);
+    flag = pTuio->hide_devices;
+    prop_pseudo_hide = _property_create(device, TUIO_PROP_PSEUDO_HIDE,
+                                        XA_INTEGER, 8, 1, &flag);
+    flag = pTuio->coalesce;
+    prop_coalesce_frames = _property_create(device,
+            TUIO_PROP_COALESCE_FRAMES, XA_INTEGER, 8, 1, &flag);
+    value = pTuio->predict_horizon / 1000000;
+    prop_predict_horizon = _property_create(device,
+            TUIO_PROP_PREDICT_HORIZON, XA_INTEGER, 32, 1, &value);
+    values[0] = pTuio->predict_smoothing;
+    values[1] = pTuio->predict_trend_smoothing;
+    prop_predict_smoothing = _property_create(device,
+            TUIO_PROP_PREDICT_SMOOTHING, float_type, 32, 2, values);
+    values[0] = pTuio->filter_min_cutoff;
+    values[1] = pTuio->filter_beta;
+    prop_filter = _property_create(device, TUIO_PROP_FILTER, float_type, 32,
+                                   2, values);
+    prop_dead_zone = _property_create(device, TUIO_PROP_DEAD_ZONE,
+                                      float_type, 32, 1, &pTuio->dead_zone);
+    value = pTuio->watchdog.timeout / 1000000;
+    prop_contact_timeout = _property_create(device,
+            TUIO_PROP_CONTACT_TIMEOUT, XA_INTEGER, 32, 1, &value);
+
+    XIRegisterPropertyHandler(device, _tuio_set_property, _tuio_get_property,
+                              NULL);
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Recording of received datagrams (Option "RecordFile").  Datagrams are
+ * copied into a ring buffer on the input path and written out by a
+ * separate thread, so that processing never waits on the disk.  The
+ * writer wakes up every RECORD_INTERVAL_MS, or as soon as the ring is half
+ * full, so that the input path rarely has to wake it.  If the
+ * writer falls behind and the ring fills up, datagrams are left out of
+ * the log and counted.
+ *
+ * The log starts with the 8 byte magic "TUIOREC1", followed by one record
+ * per datagram, all fields in network byte order:
+ *
+ *   uint32 length    Length of the datagram
+ *   uint16 port      Sender's port, 0 for a Unix socket
+ *   uint16 family    4 or 6, or 1 for a Unix socket
+ *   uint64 time      CLOCK_MONOTONIC receive time in ns
+ *   uint8  addr[16]  Sender's address, IPv4 addresses in the first 4 bytes.
+ *                    For a Unix socket, the start of its name, all zero if
+ *                    it has none.
+ *   uint8  data[length]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+#define RECORD_MAGIC "TUIOREC1"
+#define RECORD_HEADER_SIZE 32
+#define RECORD_BUFFER_SIZE (1 << 20)
+#define RECORD_INTERVAL_MS 100
+#define RECORD_FAMILY_UNIX 1
+
+struct _Recorder {
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Bool stop;
+
+    /* Ring of RECORD_BUFFER_SIZE bytes.  head and tail only grow, the
+     * writer owns the bytes between them. */
+    unsigned char *buf;
+    unsigned long long head, tail;
+
+    unsigned long dropped; /* Datagrams left out because the ring was full */
+    int error; /* errno of the write that stopped the writer, or 0 */
+};
+
+/**
+ * Writes out the ring until told to stop, then writes what is left
+ */
+static void *
+_record_thread(void *data)
+{
+    RecorderPtr rec = data;
+    unsigned long long tail;
+    struct timespec ts;
+    size_t len, off;
+    ssize_t n;
+
+    pthread_mutex_lock(&rec->lock);
+    for (;;) {
+        if (rec->head == rec->tail) {
+            if (rec->stop)
+                break;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += RECORD_INTERVAL_MS * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&rec->cond, &rec->lock, &ts);
+            continue;
+        }
+
+        /* Write up to the end of the ring, the rest comes next time */
+        tail = rec->tail;
+        off = tail % RECORD_BUFFER_SIZE;
+        len = rec->head - tail;
+        if (len > RECORD_BUFFER_SIZE - off)
+            len = RECORD_BUFFER_SIZE - off;
+        pthread_mutex_unlock(&rec->lock);
+
+        n = write(rec->fd, rec->buf + off, len);
+
+        pthread_mutex_lock(&rec->lock);
+        if (n < 0 && errno != EINTR) {
+            /* Keep taking datagrams so the input path is unaffected, but
+             * throw them away */
+            rec->error = errno;
+            rec->tail = rec->head;
+        } else if (n > 0) {
+            rec->tail = tail + n;
+        }
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    return NULL;
+}
+
+/**
+ * Opens path for appending and starts the writer thread
+ *
+ * @return NULL on error
+ */
+RecorderPtr
+TuioRecordOpen(InputInfoPtr pInfo, const char *path)
+{
+    RecorderPtr rec;
+    pthread_condattr_t attr;
+    sigset_t all, old;
+    struct stat st;
+    int res;
+
+    rec = calloc(1, sizeof(struct _Recorder));
+    if (rec == NULL)
+        return NULL;
+
+    rec->buf = malloc(RECORD_BUFFER_SIZE);
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (rec->buf == NULL || rec->fd < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to open RecordFile %s (%s)\n",
+                pInfo->name, path, strerror(errno));
+        goto fail;
+    }
+
+    /* New logs start with the magic, existing ones are appended to */
+    if (fstat(rec->fd, &st) == 0 && st.st_size == 0 &&
+        write(rec->fd, RECORD_MAGIC, 8) != 8) {
+        xf86Msg(X_ERROR, "%s: Failed to write RecordFile %s (%s)\n",
+                pInfo->name, path, strerror(errno));
+        goto fail;
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rec->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Signals are left to the server's own threads.  The SIGIO handler
+     * records datagrams, and must not interrupt the writer while it
+     * holds the lock. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    res = pthread_create(&rec->thread, NULL, _record_thread, rec);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (res != 0) {
+        xf86Msg(X_ERROR, "%s: Failed to start RecordFile writer\n",
+                pInfo->name);
+        pthread_cond_destroy(&rec->cond);
+        pthread_mutex_destroy(&rec->lock);
+        goto fail;
+    }
+
+    xf86Msg(X_INFO, "%s: Recording to %s\n", pInfo->name, path);
+    return rec;
+
+fail:
+    if (rec->fd >= 0)
+        close(rec->fd);
+    free(rec->buf);
+    free(rec);
+    return NULL;
+}
+
+/**
+ * Stops the writer once everything recorded is written, and closes the log
+ */
+void
+TuioRecordClose(InputInfoPtr pInfo, RecorderPtr rec)
+{
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = True;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    if (rec->dropped)
+        xf86Msg(X_WARNING, "%s: %lu datagrams left out of RecordFile\n",
+                pInfo->name, rec->dropped);
+    if (rec->error)
+        xf86Msg(X_ERROR, "%s: Failed to write RecordFile (%s)\n",
+                pInfo->name, strerror(rec->error));
+
+    pthread_cond_destroy(&rec->cond);
+    pthread_mutex_destroy(&rec->lock);
+    close(rec->fd);
+    free(rec->buf);
+    free(rec);
+}
+
+/**
+ * Copies len bytes into the ring at position pos
+ */
+static void
+_record_copy(RecorderPtr rec, unsigned long long pos,
+             const void *data, size_t len)
+{
+    size_t off = pos % RECORD_BUFFER_SIZE;
+    size_t first = RECORD_BUFFER_SIZE - off;
+
+    if (first >= len) {
+        memcpy(rec->buf + off, data, len);
+    } else {
+        memcpy(rec->buf + off, data, first);
+        memcpy(rec->buf, (const unsigned char *)data + first, len - first);
+    }
+}
+
+/**
+ * Queues the n datagrams just received for writing, stamped with their
+ * receive time
+ */
+void
+TuioRecordPackets(RecorderPtr rec, PacketPtr packets, int n)
+{
+    unsigned char header[RECORD_HEADER_SIZE];
+    uint32_t len;
+    uint16_t port, family;
+    int i;
+
+    pthread_mutex_lock(&rec->lock);
+
+    for (i = 0; i < n; i++) {
+        PacketPtr packet = &packets[i];
+
+        if (RECORD_BUFFER_SIZE - (rec->head - rec->tail) <
+            RECORD_HEADER_SIZE + packet->len) {
+            rec->dropped++;
+            continue;
+        }
+
+        memset(header, 0, sizeof(header));
+        len = htonl(packet->len);
+        memcpy(header, &len, 4);
+        if (packet->addr.ss_family == AF_INET6) {
+            const struct sockaddr_in6 *in6 =
+                (const struct sockaddr_in6 *)&packet->addr;
+            port = in6->sin6_port;
+            family = htons(6);
+            memcpy(header + 16, &in6->sin6_addr, 16);
+        } else if (packet->addr.ss_family == AF_UNIX) {
+            /* The names the kernel binds senders to are short enough
+             * to fit, paths may be cut short */
+            const struct sockaddr_un *un =
+                (const struct sockaddr_un *)&packet->addr;
+            size_t name = packet->addrlen -
+                offsetof(struct sockaddr_un, sun_path);
+
+            port = 0;
+            family = htons(RECORD_FAMILY_UNIX);
+            if (packet->addrlen > offsetof(struct sockaddr_un, sun_path))
+                memcpy(header + 16, un->sun_path, name < 16 ? name : 16);
+        } else {
+            const struct sockaddr_in *in =
+                (const struct sockaddr_in *)&packet->addr;
+            port = in->sin_port;
+            family = htons(4);
+            memcpy(header + 16, &in->sin_addr, 4);
+        }
+        memcpy(header + 4, &port, 2);
+        memcpy(header + 6, &family, 2);
+        len = htonl(packet->time >> 32);
+        memcpy(header + 8, &len, 4);
+        len = htonl(packet->time & 0xffffffff);
+        memcpy(header + 12, &len, 4);
+
+        _record_copy(rec, rec->head, header, RECORD_HEADER_SIZE);
+        _record_copy(rec, rec->head + RECORD_HEADER_SIZE, packet->data,
+                     packet->len);
+        rec->head += RECORD_HEADER_SIZE + packet->len;
+    }
+
+    if (rec->head - rec->tail > RECORD_BUFFER_SIZE / 2)
+        pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+
+/*
+ * Source tracking.  Every sender gets its own fseq and frame ordering
+ * state, and its session ids are kept apart from those of other senders.
+ * Senders are told apart by their address, or by the source string of
+ * their TUIO 2.0 frame messages, and can be mapped to a region of the
+ * device with the SourceN and SourceNRegion options.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+/**
+ * Reads the SourceN and SourceNRegion options, N from 1 to MAX_SOURCES
+ */
+void
+TuioSourceInit(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    SourceConfigRec *config;
+    char option[32];
+    char *name, *region;
+    int i;
+
+    pTuio->num_source_configs = 0;
+    for (i = 1; i <= MAX_SOURCES; i++) {
+        snprintf(option, sizeof(option), "Source%i", i);
+        name = xf86SetStrOption(pInfo->options, option, NULL);
+        if (name == NULL)
+            continue;
+
+        config = &pTuio->source_configs[pTuio->num_source_configs++];
+        config->name = name;
+        config->x = config->y = 0;
+        config->width = config->height = 1;
+
+        snprintf(option, sizeof(option), "Source%iRegion", i);
+        region = xf86SetStrOption(pInfo->options, option, NULL);
+        if (region != NULL &&
+            sscanf(region, "%f %f %f %f", &config->x, &config->y,
+                   &config->width, &config->height) != 4) {
+            xf86Msg(X_WARNING, "%s: Invalid %s (%s), using the whole "
+                    "device\n", pInfo->name, option, region);
+            config->x = config->y = 0;
+            config->width = config->height = 1;
+        }
+        free(region);
+
+        xf86Msg(X_INFO, "%s: Source %s mapped to %g %g %g %g\n",
+                pInfo->name, config->name, config->x, config->y,
+                config->width, config->height);
+    }
+}
+
+/**
+ * Takes a source slot for a new sender.  Slots of senders without live
+ * objects are reused, least recently heard from first.
+ *
+ * @return NULL if every source has live objects
+ */
+static SourcePtr
+_source_alloc(TuioDevicePtr pTuio)
+{
+    SourcePtr source, oldest = NULL;
+    int i;
+
+    for (i = 0; i < MAX_SOURCES; i++) {
+        source = &pTuio->sources[i];
+        if (!source->used)
+            return source;
+        if (source->num_objects == 0 &&
+            (oldest == NULL || pTuio->generation - source->generation >
+                               pTuio->generation - oldest->generation))
+            oldest = source;
+    }
+
+    return oldest;
+}
+
+/**
+ * Resets a source slot and applies the region of the first configured
+ * source matching either of its names
+ */
+static void
+_source_setup(TuioDevicePtr pTuio, SourcePtr source, const char *name,
+              const char *alt_name)
+{
+    SourceConfigRec *config;
+    int i;
+
+    memset(source, 0, sizeof(SourceRec));
+    source->used = True;
+    source->generation = pTuio->generation;
+    strncpy(source->name, name, SOURCE_NAME_LEN - 1);
+    source->width = source->height = 1;
+
+    for (i = 0; i < pTuio->num_source_configs; i++) {
+        config = &pTuio->source_configs[i];
+        if (strcmp(config->name, name) == 0 ||
+            (alt_name != NULL && strcmp(config->name, alt_name) == 0)) {
+            source->x = config->x;
+            source->y = config->y;
+            source->width = config->width;
+            source->height = config->height;
+            break;
+        }
+    }
+}
+
+/**
+ * Finds the source of a datagram by its sender's address, adding it if
+ * it is new.  A new sender matches a configured source given either as
+ * its bare address or as address:port, or for a Unix socket by its path.
+ *
+ * @return NULL if the sender is new and no source slot is free
+ */
+SourcePtr
+TuioSourceFromAddress(TuioDevicePtr pTuio,
+                      const struct sockaddr_storage *addr, socklen_t addrlen)
+{
+    char host[INET6_ADDRSTRLEN], host_port[sizeof(struct sockaddr_un)];
+    SourcePtr source;
+    int i, port;
+
+    for (i = 0; i < MAX_SOURCES; i++) {
+        source = &pTuio->sources[i];
+        if (source->used && source->addrlen == addrlen &&
+            memcmp(&source->addr, addr, addrlen) == 0) {
+            source->generation = pTuio->generation;
+            return source;
+        }
+    }
+
+    source = _source_alloc(pTuio);
+    if (source == NULL)
+        return NULL;
+
+    host[0] = '\0';
+    port = 0;
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+        inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+        port = ntohs(in->sin_port);
+        snprintf(host_port, sizeof(host_port), "%s:%i", host, port);
+    } else if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+        port = ntohs(in6->sin6_port);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+            /* An IPv4 sender received on a dual-stack socket */
+            inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], host,
+                      sizeof(host));
+            snprintf(host_port, sizeof(host_port), "%s:%i", host, port);
+        } else {
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            snprintf(host_port, sizeof(host_port), "[%s]:%i", host, port);
+        }
+    } else if (addr->ss_family == AF_UNIX &&
+               addrlen > offsetof(struct sockaddr_un, sun_path)) {
+        /* A Unix socket path, or an abstract name written as @name */
+        const struct sockaddr_un *un = (const struct sockaddr_un *)addr;
+        int len = addrlen - offsetof(struct sockaddr_un, sun_path);
+
+        if (un->sun_path[0] == '\0')
+            snprintf(host_port, sizeof(host_port), "@%.*s", len - 1,
+                     un->sun_path + 1);
+        else
+            snprintf(host_port, sizeof(host_port), "%.*s", len,
+                     un->sun_path);
+    } else {
+        host_port[0] = '\0';
+    }
+
+    _source_setup(pTuio, source, host_port, host);
+    memcpy(&source->addr, addr, addrlen);
+    source->addrlen = addrlen;
+
+    return source;
+}
+
+/**
+ * Finds the source named by a TUIO 2.0 frame message, adding it if it is
+ * new
+ *
+ * @return NULL if the source is new and no source slot is free
+ */
+SourcePtr
+TuioSourceFromName(TuioDevicePtr pTuio, const char *name)
+{
+    SourcePtr source;
+    int i;
+
+    for (i = 0; i < MAX_SOURCES; i++) {
+        source = &pTuio->sources[i];
+        if (source->used && source->addrlen == 0 &&
+            strncmp(source->name, name, SOURCE_NAME_LEN - 1) == 0) {
+            source->generation = pTuio->generation;
+            return source;
+        }
+    }
+
+    source = _source_alloc(pTuio);
+    if (source == NULL)
+        return NULL;
+
+    _source_setup(pTuio, source, name, NULL);
+
+    return source;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Run time statistics.  Latencies are kept in histograms with 4 buckets
+ * per power of two nanoseconds, so that a percentile is accurate to
+ * within 25% whatever the scale.  Histograms are only written on the
+ * input path and may be read from elsewhere at any time; the counts are
+ * updated atomically, so a reader sees a slightly stale but consistent
+ * enough picture without taking a lock.  The same goes for the counters.
+ *
+ * Errors caused by received data are rate limited, since a misbehaving
+ * sender would otherwise fill the log with one message per datagram.
+ * Messages from the input path go through the receive thread's queue
+ * while it runs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+/* At most LOG_BURST errors are logged every LOG_INTERVAL_NS */
+#define LOG_BURST 10
+#define LOG_INTERVAL_NS 10000000000ULL
+
+/**
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+unsigned long long
+TuioTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @return the bucket of a latency.  Values below 2 << HISTOGRAM_SUB_BITS
+ * have a bucket each, above that each power of two is split in
+ * 1 << HISTOGRAM_SUB_BITS.
+ */
+static inline int
+_histogram_bucket(unsigned long long ns)
+{
+    int exp, bucket;
+
+    if (ns < 2 << HISTOGRAM_SUB_BITS)
+        return ns;
+
+    exp = 63 - __builtin_clzll(ns);
+    bucket = (exp - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS |
+             (ns >> (exp - HISTOGRAM_SUB_BITS) & ((1 << HISTOGRAM_SUB_BITS) - 1));
+
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @return the largest latency that falls into bucket
+ */
+static unsigned long long
+_histogram_bucket_max(int bucket)
+{
+    int exp, sub;
+
+    if (bucket < 2 << HISTOGRAM_SUB_BITS)
+        return bucket;
+
+    exp = (bucket >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+
+    return (((1ULL << HISTOGRAM_SUB_BITS) + sub + 1) <<
+            (exp - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+/**
+ * Counts one latency
+ */
+void
+TuioHistogramAdd(HistogramPtr hist, unsigned long long ns)
+{
+    __atomic_fetch_add(&hist->counts[_histogram_bucket(ns)], 1,
+                       __ATOMIC_RELAXED);
+}
+
+/**
+ * Finds the latency below which a fraction p of the counted latencies
+ * fall, rounded up to the end of its bucket
+ *
+ * @return the latency in ns, 0 if nothing was counted.  The number of
+ * latencies counted is stored in total.
+ */
+unsigned long long
+TuioHistogramPercentile(HistogramPtr hist, double p, unsigned long *total)
+{
+    unsigned long counts[HISTOGRAM_BUCKETS];
+    unsigned long sum = 0, rank;
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        counts[i] = __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+        sum += counts[i];
+    }
+    *total = sum;
+    if (sum == 0)
+        return 0;
+
+    rank = p * sum;
+    if (rank >= sum)
+        rank = sum - 1;
+
+    sum = 0;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        sum += counts[i];
+        if (sum > rank)
+            break;
+    }
+
+    return _histogram_bucket_max(i);
+}
+
+/**
+ * Logs a message from the input path, which may be the receive thread
+ */
+void
+TuioLogInput(InputInfoPtr pInfo, MessageType type, const char *format, ...)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    char msg[256];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+
+    if (pTuio->thread != NULL)
+        TuioThreadLog(pTuio->thread, type, "%s", msg);
+    else
+        xf86Msg(type, "%s: %s", pInfo->name, msg);
+}
+
+/**
+ * Counts a malformed datagram or message and logs an error about it,
+ * unless LOG_BURST errors have already been logged in this interval.
+ * The number of errors left out is logged once the interval is over.
+ */
+void
+TuioLogMalformed(InputInfoPtr pInfo, const char *format, ...)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    RateLimitPtr limit = &pTuio->log_limit;
+    unsigned long long now = TuioTime();
+    char msg[256];
+    va_list args;
+
+    TuioCount(pTuio, malformed, 1);
+
+    if (now - limit->start >= LOG_INTERVAL_NS) {
+        if (limit->suppressed > 0)
+            TuioLogInput(pInfo, X_WARNING, "%lu similar errors not logged\n",
+                         limit->suppressed);
+        limit->start = now;
+        limit->count = 0;
+        limit->suppressed = 0;
+    }
+
+    if (limit->count >= LOG_BURST) {
+        limit->suppressed++;
+        return;
+    }
+    limit->count++;
+
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+
+    TuioLogInput(pInfo, X_ERROR, "%s", msg);
+}
@@ -0,0 +1,573 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Receive thread (Option "Threaded").  The thread blocks on the socket,
+ * decodes datagrams and resolves them into touch events just as
+ * TuioReadInput does, but queues the events instead of posting them.
+ * Events are published a frame at a time into a single-producer,
+ * single-consumer ring, and the server is woken through an eventfd that
+ * takes the place of the socket as pInfo->fd.  The input handler then
+ * only pops frames and posts their events.
+ *
+ * While the thread runs, the object table and the rest of the decoding
+ * state in TuioDeviceRec belong to it.  Subdevices come and go on the
+ * server's side, so adding or removing one takes the thread's lock,
+ * which the thread holds while it processes datagrams.
+ *
+ * The ring only drains through the input handler, so the thread never
+ * waits for it while holding its lock.  It stops receiving once the ring
+ * is nearly full, and waits for the server to catch up after releasing
+ * the lock; datagrams queue up in the socket in the meantime.  Only a
+ * datagram with more events than fit in the rest of the ring loses any,
+ * and those are counted.  The lock order is the thread's lock, then the
+ * input lock.  Code that runs with input blocked, such as timers, must
+ * not take the thread's lock.
+ *
+ * The thread can also be woken to process input without a datagram, after
+ * the socket was replaced or to end objects on the thread's side.  While
+ * it polls the socket, the socket stays open even if closed, so it is
+ * held out of poll() to replace a socket with one on the same port.
+ *
+ * The server's log is not safe to write from another thread, so messages
+ * from the input path are queued in a second, smaller ring and logged by
+ * the input handler.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+#define THREAD_RING_SIZE 32 /* Frames, a power of two */
+#define THREAD_RING_RESERVE 8 /* Free frames needed to receive more */
+#define THREAD_FRAME_EVENTS 64
+#define THREAD_WAIT_MS 1 /* Between checks of a full ring */
+#define THREAD_LOG_SIZE 16 /* Messages, a power of two */
+#define THREAD_LOG_LENGTH 256
+
+/* A touch event, or a button release on a subdevice */
+typedef struct _Event {
+    DeviceIntPtr dev;
+    int type; /* XI_TouchBegin, XI_TouchUpdate, XI_TouchEnd or
+                 ButtonRelease */
+    unsigned int touch_id;
+    unsigned int mask; /* Valuators set */
+    int valuators[NUM_VALUATORS];
+} EventRec, *EventPtr;
+
+/* The events of one datagram, or of one wakeup while coalescing */
+typedef struct _Frame {
+    unsigned long long wakeup;
+    int num_events;
+    EventRec events[THREAD_FRAME_EVENTS];
+} FrameRec, *FramePtr;
+
+/* A message for the server's log */
+typedef struct _LogLine {
+    MessageType type;
+    char msg[THREAD_LOG_LENGTH];
+} LogLineRec, *LogLinePtr;
+
+struct _Thread {
+    InputInfoPtr pInfo;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* Signals changes to hold and held */
+    Bool hold; /* Set to keep the thread from polling */
+    Bool held; /* Set while the thread is kept from polling */
+    int event_fd; /* Written when frames have been published */
+    int stop_fd; /* Written to stop the thread */
+    int wake_fd; /* Written to make the thread process input */
+    ValuatorMask *vmask; /* Used by the input handler to post events */
+
+    /* Only touched by the thread */
+    unsigned long long wakeup; /* When the socket was found readable */
+    int num_events; /* In the frame being built at head */
+    Bool publish; /* Frames published since event_fd was written */
+    unsigned long waits; /* Times the ring was found nearly full */
+    unsigned long dropped; /* Events that found the ring full */
+
+    /* head and tail only grow, the input handler owns the frames between
+     * them.  Kept apart so that the two sides don't share a cache line. */
+    unsigned int head __attribute__((aligned(64)));
+    unsigned int tail __attribute__((aligned(64)));
+
+    FrameRec frames[THREAD_RING_SIZE];
+
+    /* Messages are queued like frames, and counted in log_lost if the
+     * queue is full */
+    unsigned int log_head, log_tail;
+    unsigned long log_lost;
+    LogLineRec log[THREAD_LOG_SIZE];
+};
+
+/**
+ * Wakes the server if frames were published since it was last woken
+ */
+static void
+_thread_signal(ThreadPtr thread)
+{
+    uint64_t one = 1;
+
+    if (!thread->publish)
+        return;
+    thread->publish = False;
+
+    /* Only fails when the counter would overflow, in which case the
+     * server is being woken anyway */
+    if (write(thread->event_fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+/**
+ * @return the number of free frames in the ring
+ */
+static inline unsigned int
+_thread_free(ThreadPtr thread)
+{
+    return THREAD_RING_SIZE - (thread->head -
+        __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Waits until the ring has room to receive more.  Called without the
+ * thread's lock.
+ *
+ * @return False if the thread was stopped while waiting
+ */
+static Bool
+_thread_wait_room(ThreadPtr thread)
+{
+    struct pollfd pfd;
+
+    if (_thread_free(thread) >= THREAD_RING_RESERVE)
+        return True;
+
+    thread->waits++;
+    pfd.fd = thread->stop_fd;
+    pfd.events = POLLIN;
+    while (_thread_free(thread) < THREAD_RING_RESERVE) {
+        if (poll(&pfd, 1, THREAD_WAIT_MS) > 0)
+            return False;
+    }
+
+    return True;
+}
+
+/**
+ * Processes datagrams as they arrive until told to stop
+ */
+static void *
+_thread_main(void *data)
+{
+    ThreadPtr thread = data;
+    InputInfoPtr pInfo = thread->pInfo;
+    TuioDevicePtr pTuio = pInfo->private;
+    struct pollfd pfd[3];
+    uint64_t count;
+
+    pfd[0].fd = pTuio->socket_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = thread->stop_fd;
+    pfd[1].events = POLLIN;
+    pfd[2].fd = thread->wake_fd;
+    pfd[2].events = POLLIN;
+
+    for (;;) {
+        if (poll(pfd, 3, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            TuioThreadLog(thread, X_ERROR, "Receive thread failed (%s)\n",
+                          strerror(errno));
+            _thread_signal(thread);
+            break;
+        }
+        if (pfd[1].revents)
+            break;
+        if (pfd[2].revents &&
+            read(thread->wake_fd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN)
+            TuioThreadLog(thread, X_ERROR, "Failed to read eventfd (%s)\n",
+                          strerror(errno));
+
+        thread->wakeup = TuioTime();
+        pthread_mutex_lock(&thread->lock);
+        TuioProcessInput(pInfo, thread->wakeup);
+        while (thread->hold) {
+            thread->held = True;
+            pthread_cond_broadcast(&thread->cond);
+            pthread_cond_wait(&thread->cond, &thread->lock);
+        }
+        thread->held = False;
+        pfd[0].fd = pTuio->socket_fd; /* May have been replaced */
+        pthread_mutex_unlock(&thread->lock);
+        _thread_signal(thread);
+
+        if (!_thread_wait_room(thread))
+            break;
+    }
+
+    pthread_mutex_lock(&thread->lock);
+    thread->held = True;
+    pthread_cond_broadcast(&thread->cond);
+    pthread_mutex_unlock(&thread->lock);
+
+    return NULL;
+}
+
+/**
+ * Logs the messages queued by the thread.  Called from the input handler.
+ */
+static void
+_thread_flush_log(InputInfoPtr pInfo, ThreadPtr thread)
+{
+    unsigned int head, tail = thread->log_tail;
+    unsigned long lost;
+    LogLinePtr line;
+
+    head = __atomic_load_n(&thread->log_head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        line = &thread->log[tail & (THREAD_LOG_SIZE - 1)];
+        xf86Msg(line->type, "%s: %s", pInfo->name, line->msg);
+        tail++;
+        __atomic_store_n(&thread->log_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    lost = __atomic_exchange_n(&thread->log_lost, 0, __ATOMIC_RELAXED);
+    if (lost)
+        xf86Msg(X_WARNING, "%s: %lu messages from the receive thread not "
+                "logged\n", pInfo->name, lost);
+}
+
+/**
+ * Starts the receive thread on pTuio->socket_fd.  pTuio->thread is set
+ * before the thread starts, so that the input path queues its events
+ * from the first datagram on.  On success pInfo->fd is replaced by the
+ * eventfd the thread signals.
+ *
+ * @return NULL on error
+ */
+ThreadPtr
+TuioThreadStart(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ThreadPtr thread;
+    sigset_t all, old;
+    int res;
+
+    thread = calloc(1, sizeof(struct _Thread));
+    if (thread == NULL)
+        return NULL;
+
+    thread->pInfo = pInfo;
+    thread->vmask = valuator_mask_new(NUM_VALUATORS);
+    thread->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    thread->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    thread->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (thread->vmask == NULL || thread->event_fd < 0 ||
+        thread->stop_fd < 0 || thread->wake_fd < 0) {
+        xf86Msg(X_ERROR, "%s: Failed to set up receive thread (%s)\n",
+                pInfo->name, strerror(errno));
+        goto fail;
+    }
+
+    /* Signals are left to the server's own threads */
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->cond, NULL);
+    pTuio->thread = thread;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    res = pthread_create(&thread->thread, NULL, _thread_main, thread);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (res != 0) {
+        xf86Msg(X_ERROR, "%s: Failed to start receive thread\n",
+                pInfo->name);
+        pTuio->thread = NULL;
+        pthread_mutex_destroy(&thread->lock);
+        pthread_cond_destroy(&thread->cond);
+        goto fail;
+    }
+
+    pInfo->fd = thread->event_fd;
+    xf86Msg(X_INFO, "%s: Receiving in a separate thread\n", pInfo->name);
+    return thread;
+
+fail:
+    if (thread->event_fd >= 0)
+        close(thread->event_fd);
+    if (thread->stop_fd >= 0)
+        close(thread->stop_fd);
+    if (thread->wake_fd >= 0)
+        close(thread->wake_fd);
+    if (thread->vmask != NULL)
+        valuator_mask_free(&thread->vmask);
+    free(thread);
+    return NULL;
+}
+
+/**
+ * Stops the receive thread.  Frames that were not posted yet are dropped.
+ * The caller restores pInfo->fd.
+ */
+void
+TuioThreadStop(InputInfoPtr pInfo, ThreadPtr thread)
+{
+    uint64_t one = 1;
+
+    if (write(thread->stop_fd, &one, sizeof(one)) < 0)
+        xf86Msg(X_ERROR, "%s: Failed to stop receive thread (%s)\n",
+                pInfo->name, strerror(errno));
+    pthread_join(thread->thread, NULL);
+    _thread_flush_log(pInfo, thread);
+
+    if (thread->waits)
+        xf86Msg(X_WARNING, "%s: Receive thread waited %lu times for the "
+                "server to catch up\n", pInfo->name, thread->waits);
+    if (thread->dropped)
+        xf86Msg(X_WARNING, "%s: Receive thread dropped %lu events that "
+                "did not fit in its queue\n", pInfo->name, thread->dropped);
+
+    pthread_mutex_destroy(&thread->lock);
+    pthread_cond_destroy(&thread->cond);
+    close(thread->event_fd);
+    close(thread->stop_fd);
+    close(thread->wake_fd);
+    valuator_mask_free(&thread->vmask);
+    free(thread);
+}
+
+/**
+ * @return whether the ring has room for the events of another datagram.
+ * Called from the thread only.
+ */
+Bool
+TuioThreadRoom(ThreadPtr thread)
+{
+    return _thread_free(thread) >= THREAD_RING_RESERVE;
+}
+
+/**
+ * Queues a message for the server's log, to be logged with the device's
+ * name by the input handler.  Called from the thread only.
+ */
+void
+TuioThreadLog(ThreadPtr thread, MessageType type, const char *format, ...)
+{
+    LogLinePtr line;
+    va_list args;
+
+    if (thread->log_head -
+        __atomic_load_n(&thread->log_tail, __ATOMIC_ACQUIRE) ==
+        THREAD_LOG_SIZE) {
+        __atomic_fetch_add(&thread->log_lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    line = &thread->log[thread->log_head & (THREAD_LOG_SIZE - 1)];
+    line->type = type;
+    va_start(args, format);
+    vsnprintf(line->msg, sizeof(line->msg), format, args);
+    va_end(args);
+    __atomic_store_n(&thread->log_head, thread->log_head + 1,
+                     __ATOMIC_RELEASE);
+    thread->publish = True;
+}
+
+/**
+ * Makes the thread process input once, whether or not a datagram is
+ * pending
+ */
+void
+TuioThreadWake(ThreadPtr thread)
+{
+    uint64_t one = 1;
+
+    /* Only fails when the counter would overflow, in which case the
+     * thread is being woken anyway */
+    if (write(thread->wake_fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+void
+TuioThreadLock(ThreadPtr thread)
+{
+    pthread_mutex_lock(&thread->lock);
+}
+
+void
+TuioThreadUnlock(ThreadPtr thread)
+{
+    pthread_mutex_unlock(&thread->lock);
+}
+
+/**
+ * Takes the thread's lock once the thread has left poll(), and keeps it
+ * from polling again until TuioThreadResume().  The sockets it polled can
+ * then be closed for good.
+ */
+void
+TuioThreadHold(ThreadPtr thread)
+{
+    pthread_mutex_lock(&thread->lock);
+    thread->hold = True;
+    TuioThreadWake(thread);
+    while (!thread->held)
+        pthread_cond_wait(&thread->cond, &thread->lock);
+}
+
+/**
+ * Releases the thread's lock taken by TuioThreadHold().  The thread polls
+ * pTuio->socket_fd from then on.
+ */
+void
+TuioThreadResume(ThreadPtr thread)
+{
+    thread->hold = False;
+    pthread_cond_broadcast(&thread->cond);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+/**
+ * Adds an event to the frame being built.  type is an XI touch event type
+ * or ButtonRelease, vmask may be NULL for the latter.  Called from the
+ * thread only.
+ */
+void
+TuioThreadQueue(ThreadPtr thread, DeviceIntPtr dev, int type,
+                unsigned int touch_id, const ValuatorMask *vmask)
+{
+    EventPtr event;
+    int i;
+
+    /* Very large frames are published in parts */
+    if (thread->num_events == THREAD_FRAME_EVENTS)
+        TuioThreadFrameDone(thread);
+    if (thread->num_events == 0 && _thread_free(thread) == 0) {
+        thread->dropped++;
+        return;
+    }
+
+    event = &thread->frames[thread->head & (THREAD_RING_SIZE - 1)]
+        .events[thread->num_events++];
+    event->dev = dev;
+    event->type = type;
+    event->touch_id = touch_id;
+    event->mask = 0;
+    if (vmask == NULL)
+        return;
+
+    for (i = 0; i < NUM_VALUATORS; i++) {
+        if (valuator_mask_isset(vmask, i)) {
+            event->mask |= 1 << i;
+            event->valuators[i] = valuator_mask_get(vmask, i);
+        }
+    }
+}
+
+/**
+ * Publishes the frame being built, if it has any events.  Called from the
+ * thread only.
+ */
+void
+TuioThreadFrameDone(ThreadPtr thread)
+{
+    FramePtr frame = &thread->frames[thread->head & (THREAD_RING_SIZE - 1)];
+
+    if (thread->num_events == 0)
+        return;
+
+    frame->wakeup = thread->wakeup;
+    frame->num_events = thread->num_events;
+    thread->num_events = 0;
+    __atomic_store_n(&thread->head, thread->head + 1, __ATOMIC_RELEASE);
+    thread->publish = True;
+}
+
+/**
+ * Posts the events of all published frames, and logs the thread's
+ * messages.  Called from the input handler.
+ */
+void
+TuioThreadPost(InputInfoPtr pInfo, ThreadPtr thread)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    unsigned int head, tail = thread->tail;
+    uint64_t count;
+    FramePtr frame;
+    EventPtr event;
+    int i, j;
+
+    /* Reset the eventfd before looking at the ring, so that frames
+     * published from here on wake the server again */
+    if (read(thread->event_fd, &count, sizeof(count)) < 0 &&
+        errno != EAGAIN)
+        xf86Msg(X_ERROR, "%s: Failed to read eventfd (%s)\n",
+                pInfo->name, strerror(errno));
+    _thread_flush_log(pInfo, thread);
+
+    head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        frame = &thread->frames[tail & (THREAD_RING_SIZE - 1)];
+        for (i = 0; i < frame->num_events; i++) {
+            event = &frame->events[i];
+            if (event->type == ButtonRelease) {
+                xf86PostButtonEvent(event->dev, TRUE, 1, FALSE, 0, 0);
+                continue;
+            }
+
+            valuator_mask_zero(thread->vmask);
+            for (j = 0; j < NUM_VALUATORS; j++) {
+                if (event->mask & (1 << j))
+                    valuator_mask_set(thread->vmask, j,
+                                      event->valuators[j]);
+            }
+            xf86PostTouchEvent(event->dev, event->touch_id, event->type, 0,
+                               thread->vmask);
+        }
+        TuioHistogramAdd(&pTuio->frame_latency, TuioTime() - frame->wakeup);
+
+        tail++;
+        __atomic_store_n(&thread->tail, tail, __ATOMIC_RELEASE);
+        if (tail == head)
+            head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+    }
+}
@@ -30,6 +30,7 @@
 #endif
 
 #include <unistd.h>
+#include <math.h>
 
 #include <xf86Xinput.h>
 #include <xf86_OSlib.h>
@@ -62,6 +63,40 @@ TuioObjReadInput(InputInfoPtr pInfo);
 static void
 TuioReadInput(InputInfoPtr);
 
+static void
+_tuio_process_packet(InputInfoPtr pInfo, PacketPtr packet,
+                     unsigned long long wakeup);
+
+static void
+_tuio_post_updates(InputInfoPtr pInfo);
+
+static void
+_tuio_post_touch(InputInfoPtr pInfo, ObjectPtr obj, int type);
+
+static void
+_tuio_frame_done(TuioDevicePtr pTuio, unsigned long long wakeup);
+
+static void
+_tuio_process_due(InputInfoPtr pInfo, unsigned long long now);
+
+static void
+_tuio_end_unconfirmed(InputInfoPtr pInfo, unsigned long long wakeup);
+
+static void
+_tuio_end_stale(InputInfoPtr pInfo, unsigned long long now);
+
+static lo_server
+_tuio_lo_server_new(InputInfoPtr pInfo, int port);
+
+static void
+_tuio_rebind_discard(InputInfoPtr pInfo);
+
+static inline CARD32
+_tuio_watchdog_interval(TuioDevicePtr pTuio);
+
+static CARD32
+_tuio_watchdog_timeout(OsTimerPtr timer, CARD32 now, pointer arg);
+
 static int
 TuioControl(DeviceIntPtr, int);
 
@@ -81,26 +116,95 @@ _tuio_lo_2dcur_handle(const char *path,
                    void *data,
                    void *user_data);
 
+static int
+_tuio_lo_2dobj_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
+static int
+_tuio_lo_2dblb_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
+static int
+_tuio_lo_frm_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
+static int
+_tuio_lo_ptr_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
+static int
+_tuio_lo_tok_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
+static int
+_tuio_lo_alv_handle(const char *path,
+                   const char *types,
+                   lo_arg **argv,
+                   int argc,
+                   void *data,
+                   void *user_data);
+
 static void
 _free_tuiodev(TuioDevicePtr pTuio);
 
+static inline void
+_object_set_valuators(TuioDevicePtr pTuio, ObjectPtr obj, Bool raw);
+
+static inline Bool
+_object_in_dead_zone(TuioDevicePtr pTuio, ObjectPtr obj);
+
+static inline void
+_object_derive_velocity(ObjectPtr obj, unsigned long long time);
+
+static inline unsigned long long
+_tuio_frame_time(TuioDevicePtr pTuio, PacketPtr packet);
+
 static void
 _lo_error(int num,
          const char *msg,
          const char *path);
 
-/* Object and Subdev list manipulation functions */
-static ObjectPtr
-_object_get(ObjectPtr head, int id);
+/* Object table and Subdev list manipulation functions */
+static Bool
+_object_pool_init(TuioDevicePtr pTuio, int size);
 
 static ObjectPtr 
-_object_new(int id);
+_object_new(TuioDevicePtr pTuio, int source, int id);
 
 static void
-_object_add(ObjectPtr *obj_list, ObjectPtr obj);
+_object_release(InputInfoPtr pInfo, ObjectPtr obj);
 
-static ObjectPtr
-_object_remove(ObjectPtr *obj_list, int id);
+static void
+_object_end(InputInfoPtr pInfo, ObjectPtr obj);
+
+static void
+_subdev_pool_init(TuioDevicePtr pTuio);
+
+static SubDevicePtr
+_subdev_alloc(TuioDevicePtr pTuio);
+
+static void
+_subdev_free(TuioDevicePtr pTuio, SubDevicePtr subdev);
 
 static void
 _subdev_add(InputInfoPtr pInfo, SubDevicePtr subdev);
@@ -111,6 +215,9 @@ _subdev_remove(InputInfoPtr pInfo, InputInfoPtr sub_pInfo);
 static SubDevicePtr
 _subdev_get(InputInfoPtr pInfo, SubDevicePtr *subdev_list);
 
+static void
+_subdev_lock(InputInfoPtr pInfo, Bool lock);
+
 
 
 /* Driver information */
@@ -179,7 +286,9 @@ TuioPreInit(InputDriverPtr drv,
     TuioDevicePtr pTuio = NULL;
     ObjectPtr obj;
     char *type;
-    int num_subdev, tuio_port;
+    char *overflow, *decoder;
+    int num_subdev, tuio_port, max_contacts, predict_horizon;
+    int contact_timeout;
 
     //if (!(pInfo = xf86AllocateInput(drv, 0)))
      //   return NULL;
@@ -192,15 +301,17 @@ TuioPreInit(InputDriverPtr drv,
 
     } else {
 */
-        if (!(pTuio = malloc(sizeof(TuioDeviceRec)))) {
-            xf86DeleteInput(pInfo, 0);
-            return NULL;
-        }
+        /* On failure the server deletes pInfo itself */
+        if (!(pTuio = calloc(1, sizeof(TuioDeviceRec))))
+            return BadAlloc;
         g_pInfo = pInfo;
 
         pInfo->private = pTuio;
 
         pTuio->num_subdev = 0;
+        pTuio->socket_fd = -1; /* Until the device is enabled */
+        pTuio->socket_dir = -1;
+        pTuio->rebind_fd = -1;
 
         /* Get the number of subdevices we need to create */
         num_subdev = xf86SetIntOption(pInfo->options, "SubDevices",
@@ -212,6 +323,74 @@ TuioPreInit(InputDriverPtr drv,
         }
         pTuio->init_num_subdev = num_subdev;
 
+        /* Get the maximum number of simultaneous objects, all object
+         * storage is allocated up front */
+        max_contacts = xf86SetIntOption(pInfo->options, "MaxContacts",
+                DEFAULT_MAX_CONTACTS);
+        if (max_contacts > MAX_CONTACTS) {
+            max_contacts = MAX_CONTACTS;
+        } else if (max_contacts < MIN_CONTACTS) {
+            max_contacts = MIN_CONTACTS;
+        }
+        pTuio->max_contacts = max_contacts;
+        xf86Msg(X_INFO, "%s: MaxContacts set to %i\n",
+                pInfo->name, max_contacts);
+
+        if (!_object_pool_init(pTuio, max_contacts)) {
+            xf86Msg(X_ERROR, "%s: Failed to allocate object storage\n",
+                    pInfo->name);
+            _free_tuiodev(pTuio);
+            pInfo->private = NULL;
+            return BadAlloc;
+        }
+        _subdev_pool_init(pTuio);
+
+        /* Get the policy for new objects once all are in use */
+        overflow = xf86SetStrOption(pInfo->options, "ContactOverflow", "Drop");
+        if (strcasecmp(overflow, "Evict") == 0) {
+            pTuio->overflow_policy = OVERFLOW_EVICT;
+        } else {
+            if (strcasecmp(overflow, "Drop") != 0)
+                xf86Msg(X_WARNING, "%s: Invalid ContactOverflow (%s), "
+                        "defaulting to Drop\n", pInfo->name, overflow);
+            pTuio->overflow_policy = OVERFLOW_DROP;
+        }
+        free(overflow);
+
+        /* Get the OSC decoder to use */
+        decoder = xf86SetStrOption(pInfo->options, "Decoder", "liblo");
+        if (strcasecmp(decoder, "native") == 0) {
+            pTuio->decoder = DECODER_NATIVE;
+        } else {
+            if (strcasecmp(decoder, "liblo") != 0)
+                xf86Msg(X_WARNING, "%s: Invalid Decoder (%s), "
+                        "defaulting to liblo\n", pInfo->name, decoder);
+            pTuio->decoder = DECODER_LIBLO;
+        }
+        free(decoder);
+
+        /* Get the number of datagrams to receive per call */
+        pTuio->recv_batch = xf86SetIntOption(pInfo->options, "ReceiveBatch",
+                DEFAULT_RECV_BATCH);
+        if (pTuio->recv_batch > MAX_RECV_BATCH) {
+            pTuio->recv_batch = MAX_RECV_BATCH;
+        } else if (pTuio->recv_batch < 1) {
+            pTuio->recv_batch = 1;
+        }
+#ifndef HAVE_RECVMMSG
+        if (pTuio->recv_batch > 1)
+            xf86Msg(X_WARNING, "%s: recvmmsg() not available, "
+                    "ReceiveBatch uses one recv() per datagram\n",
+                    pInfo->name);
+#endif
+        if (!TuioNetInit(pTuio)) {
+            xf86Msg(X_ERROR, "%s: Failed to allocate receive buffers\n",
+                    pInfo->name);
+            _free_tuiodev(pTuio);
+            pInfo->private = NULL;
+            return BadAlloc;
+        }
+
         /* Get the TUIO port number to use */
         tuio_port = xf86SetIntOption(pInfo->options, "Port", DEFAULT_PORT);
         if (tuio_port < 0 || tuio_port > 65535) {
@@ -223,6 +402,44 @@ TuioPreInit(InputDriverPtr drv,
                 pInfo->name, tuio_port);
         pTuio->tuio_port = tuio_port;
 
+        /* Get where and how to listen.  liblo binds its own socket, so
+         * only the native decoder can choose the address or transport. */
+        pTuio->socket_path = xf86SetStrOption(pInfo->options,
+                "SocketPath", NULL);
+        pTuio->listen_address = xf86SetStrOption(pInfo->options,
+                "ListenAddress", NULL);
+        pTuio->reuse_port = xf86SetBoolOption(pInfo->options,
+                "ReusePort", False);
+        if (pTuio->decoder != DECODER_NATIVE &&
+            (pTuio->socket_path != NULL || pTuio->listen_address != NULL ||
+             pTuio->reuse_port)) {
+            xf86Msg(X_WARNING, "%s: SocketPath, ListenAddress and ReusePort "
+                    "need Decoder \"native\", ignoring them\n",
+                    pInfo->name);
+            free(pTuio->socket_path);
+            pTuio->socket_path = NULL;
+            free(pTuio->listen_address);
+            pTuio->listen_address = NULL;
+            pTuio->reuse_port = False;
+        }
+        pTuio->listen_interface = xf86SetStrOption(pInfo->options,
+                "ListenInterface", NULL);
+        if (pTuio->socket_path != NULL) {
+            xf86Msg(X_INFO, "%s: Listening on Unix socket %s instead\n",
+                    pInfo->name, pTuio->socket_path);
+            TuioNetUnixInit(pInfo);
+            free(pTuio->listen_address);
+            pTuio->listen_address = NULL;
+            free(pTuio->listen_interface);
+            pTuio->listen_interface = NULL;
+        }
+        pTuio->recv_buffer = xf86SetIntOption(pInfo->options,
+                "ReceiveBuffer", 0);
+        if (pTuio->recv_buffer > MAX_RECV_BUFFER)
+            pTuio->recv_buffer = MAX_RECV_BUFFER;
+        else if (pTuio->recv_buffer < 0)
+            pTuio->recv_buffer = 0;
+
         /* Get setting for checking fseq numbers in TUIO packets */
         pTuio->fseq_threshold= xf86SetIntOption(pInfo->options,
                 "FseqThreshold", DEFAULT_FSEQ_THRESHOLD);
@@ -240,6 +457,77 @@ TuioPreInit(InputDriverPtr drv,
         /* Get setting for whether to hide devices when idle */
         pTuio->hide_devices = xf86SetBoolOption(pInfo->options,
                 "PseudoHide", True);
+
+        /* Get setting for whether to post only the newest update of
+         * each object per wakeup */
+        pTuio->coalesce = xf86SetBoolOption(pInfo->options,
+                "CoalesceFrames", False);
+
+        /* Get setting for whether to receive in a separate thread */
+        pTuio->threaded = xf86SetBoolOption(pInfo->options,
+                "Threaded", False);
+
+        /* Get the settings for predicting touch positions */
+        predict_horizon = xf86SetIntOption(pInfo->options,
+                "PredictHorizon", 0);
+        if (predict_horizon > MAX_PREDICT_HORIZON) {
+            predict_horizon = MAX_PREDICT_HORIZON;
+        } else if (predict_horizon < 0) {
+            predict_horizon = 0;
+        }
+        pTuio->predict_horizon = predict_horizon * 1000000ULL;
+        pTuio->predict_smoothing = xf86SetRealOption(pInfo->options,
+                "PredictSmoothing", DEFAULT_PREDICT_SMOOTHING);
+        if (pTuio->predict_smoothing <= 0 || pTuio->predict_smoothing > 1)
+            pTuio->predict_smoothing = DEFAULT_PREDICT_SMOOTHING;
+        pTuio->predict_trend_smoothing = xf86SetRealOption(pInfo->options,
+                "PredictTrendSmoothing", DEFAULT_PREDICT_TREND_SMOOTHING);
+        if (pTuio->predict_trend_smoothing <= 0 ||
+            pTuio->predict_trend_smoothing > 1)
+            pTuio->predict_trend_smoothing = DEFAULT_PREDICT_TREND_SMOOTHING;
+        if (predict_horizon)
+            xf86Msg(X_INFO, "%s: Predicting touches %i ms ahead\n",
+                    pInfo->name, predict_horizon);
+
+        /* Get the settings for filtering jitter */
+        pTuio->filter_min_cutoff = xf86SetRealOption(pInfo->options,
+                "FilterMinCutoff", 0);
+        if (pTuio->filter_min_cutoff < 0)
+            pTuio->filter_min_cutoff = 0;
+        pTuio->filter_beta = xf86SetRealOption(pInfo->options,
+                "FilterBeta", DEFAULT_FILTER_BETA);
+        if (pTuio->filter_beta < 0)
+            pTuio->filter_beta = DEFAULT_FILTER_BETA;
+        pTuio->dead_zone = xf86SetRealOption(pInfo->options,
+                "DeadZone", 0);
+        if (pTuio->dead_zone < 0)
+            pTuio->dead_zone = 0;
+        if (pTuio->filter_min_cutoff > 0)
+            xf86Msg(X_INFO, "%s: Filtering touches with a %.2f Hz cutoff\n",
+                    pInfo->name, pTuio->filter_min_cutoff);
+
+        /* Get the time after which silent contacts are ended */
+        contact_timeout = xf86SetIntOption(pInfo->options,
+                "ContactTimeout", 0);
+        if (contact_timeout > MAX_CONTACT_TIMEOUT) {
+            contact_timeout = MAX_CONTACT_TIMEOUT;
+        } else if (contact_timeout < 0) {
+            contact_timeout = 0;
+        }
+        TuioWatchdogSetTimeout(pTuio, contact_timeout * 1000000ULL);
+        if (contact_timeout)
+            xf86Msg(X_INFO, "%s: Ending touches not seen for %i ms\n",
+                    pInfo->name, contact_timeout);
+
+        /* Get the mapping from TUIO to device coordinates */
+        TuioCalibrationInit(pInfo);
+
+        /* Get the senders that are mapped to part of the device */
+        TuioSourceInit(pInfo);
+
+        /* Get the file to record received datagrams to, if any */
+        pTuio->record_file = xf86SetStrOption(pInfo->options, "RecordFile",
+                NULL);
     //}
 
     /* Set up InputInfoPtr */
@@ -258,16 +546,22 @@ TuioPreInit(InputDriverPtr drv,
     //pInfo->flags |= XI86_OPEN_ON_INIT;
     //pInfo->flags |= XI86_CONFIGURED;
 
+    return Success;
 }
 
 /**
- * Clean up
+ * Clean up, after the device was closed.  Only the main device has a
+ * TuioDeviceRec, which xf86DeleteInput() would free without its buffers.
  */
 static void
 TuioUnInit(InputDriverPtr drv,
            InputInfoPtr pInfo,
            int flags)
 {
+    if (pInfo->private != NULL) {
+        _free_tuiodev(pInfo->private);
+        pInfo->private = NULL;
+    }
     xf86DeleteInput(pInfo, 0);
 }
 
@@ -280,108 +574,436 @@ TuioObjReadInput(InputInfoPtr pInfo) {
 }
 
 /**
- * Handle new TUIO  data on the socket
+ * Handle new TUIO  data on the socket, or the events of frames resolved
+ * by the receive thread
  */
 static void
 TuioReadInput(InputInfoPtr pInfo)
 {
     TuioDevicePtr pTuio = pInfo->private;
-    ObjectPtr *obj_list = &pTuio->obj_list;
-    ObjectPtr obj = pTuio->obj_list;
-    SubDevicePtr *subdev_list = &pTuio->subdev_list;
+
+    if (pTuio->thread != NULL)
+        TuioThreadPost(pInfo, pTuio->thread);
+    else
+        TuioProcessInput(pInfo, TuioTime());
+}
+
+/**
+ * Receives and processes everything pending on the socket.  wakeup is
+ * the time the socket was found readable.
+ */
+void
+TuioProcessInput(InputInfoPtr pInfo, unsigned long long wakeup)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    int n, i;
+
+    pTuio->wakeups++;
+
+    /* Drain the socket.  A short batch means nothing else is pending.  A
+     * receive thread stops early once its queue is nearly full, and comes
+     * back for the rest when the server has caught up. */
+    do {
+        n = TuioNetReceive(pInfo);
+        if (pTuio->recorder != NULL && n > 0)
+            TuioRecordPackets(pTuio->recorder, pTuio->packets, n);
+        for (i = 0; i < n; i++)
+            _tuio_process_packet(pInfo, &pTuio->packets[i], wakeup);
+    } while (n == pTuio->recv_batch &&
+             (pTuio->thread == NULL || TuioThreadRoom(pTuio->thread)));
+
+    if (pTuio->coalesce) {
+        _tuio_post_updates(pInfo);
+        _tuio_frame_done(pTuio, wakeup);
+    }
+
+    _tuio_process_due(pInfo, wakeup);
+}
+
+/**
+ * Does the work that timers left for the side owning the objects.  The
+ * flags are set by timers without any lock, see _tuio_schedule().
+ */
+static void
+_tuio_process_due(InputInfoPtr pInfo, unsigned long long now)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    if (__atomic_exchange_n(&pTuio->rebind_expired, False, __ATOMIC_ACQUIRE))
+        _tuio_end_unconfirmed(pInfo, now);
+    if (__atomic_exchange_n(&pTuio->watchdog_due, False, __ATOMIC_ACQUIRE))
+        _tuio_end_stale(pInfo, now);
+}
+
+/**
+ * Ends the objects that the watchdog found not seen for ContactTimeout
+ */
+static void
+_tuio_end_stale(InputInfoPtr pInfo, unsigned long long now)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ObjectPtr obj, next;
+    int ended = 0;
+
+    for (obj = TuioWatchdogExpire(pTuio, now); obj != NULL; obj = next) {
+        next = obj->watch_next;
+        _object_end(pInfo, obj);
+        ended++;
+    }
+
+    if (ended) {
+        TuioCount(pTuio, expired, ended);
+        _tuio_frame_done(pTuio, now);
+    }
+}
+
+/**
+ * Ends the objects that no frame has listed since the last rebind
+ */
+static void
+_tuio_end_unconfirmed(InputInfoPtr pInfo, unsigned long long wakeup)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ObjectPtr obj, next;
+    int ended = 0;
+
+    for (obj = pTuio->objects.head; obj != NULL; obj = next) {
+        next = obj->next;
+        if ((int)(obj->alive - pTuio->rebind_generation) > 0)
+            continue;
+        _object_end(pInfo, obj);
+        ended++;
+    }
+
+    if (ended) {
+        TuioLogInput(pInfo, X_INFO,
+                     "Ended %i touches not seen since rebinding\n", ended);
+        _tuio_frame_done(pTuio, wakeup);
+    }
+}
+
+/**
+ * Posts a touch event for an object, or queues it while the receive
+ * thread runs
+ */
+static void
+_tuio_post_touch(InputInfoPtr pInfo, ObjectPtr obj, int type)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    /* Touches end where they were last seen */
+    _object_set_valuators(pTuio, obj, type == XI_TouchEnd);
+    if (pTuio->thread != NULL)
+        TuioThreadQueue(pTuio->thread, pInfo->dev, type, obj->touch_id,
+                        pTuio->vmask);
+    else
+        xf86PostTouchEvent(pInfo->dev, obj->touch_id, type, 0,
+                           pTuio->vmask);
+}
+
+/**
+ * Marks the end of the events of a datagram, or of a wakeup while
+ * coalescing.  With a receive thread, the frame latency is counted once
+ * the events are posted.
+ */
+static void
+_tuio_frame_done(TuioDevicePtr pTuio, unsigned long long wakeup)
+{
+    if (pTuio->thread != NULL)
+        TuioThreadFrameDone(pTuio->thread);
+    else
+        TuioHistogramAdd(&pTuio->frame_latency, TuioTime() - wakeup);
+}
+
+/**
+ * Post the updates deferred while coalescing, one per object
+ */
+static void
+_tuio_post_updates(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ObjectPtr obj;
+
+    for (obj = pTuio->objects.head; obj != NULL; obj = obj->next) {
+        if (obj->pending.update) {
+            _tuio_post_touch(pInfo, obj, XI_TouchUpdate);
+            obj->pending.update = False;
+        }
+    }
+}
+
+/**
+ * Decode a single datagram and post the resulting events.  wakeup is the
+ * time the socket was found readable.
+ */
+static void
+_tuio_process_packet(InputInfoPtr pInfo, PacketPtr packet,
+                     unsigned long long wakeup)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ObjectTablePtr objects = &pTuio->objects;
+    ObjectPtr obj;
     ObjectPtr objtmp;
-    int valuators[NUM_VALUATORS];
-    
-    ValuatorMask * vmask = valuator_mask_new(NUM_VALUATORS);
-    while (xf86WaitForInput(pInfo->fd, 0) > 0)
-    {
-        /* The liblo handler will set this flag if anything was processed */
-        pTuio->processed = 0;
+    SourcePtr source;
+    unsigned long long time;
+    Bool reshaped;
+    int accept, p;
+
+    /* Each sender has its own session ids and frame sequence.  If every
+     * source slot is taken by a sender with live objects, the datagram
+     * is dropped */
+    pTuio->source = TuioSourceFromAddress(pTuio, &packet->addr,
+                                          packet->addrlen);
+    if (pTuio->source == NULL)
+        return;
 
-        /* liblo will receive a message and call the appropriate
+    /* The message handlers will set these flags for each profile that
+     * was processed, or that had an alive message */
+    pTuio->processed = 0;
+    pTuio->alive_seen = 0;
+    pTuio->frame_accept = False;
+
+    /* Objects listed in an alive message are stamped with the
+     * generation of the frame they were seen in */
+    pTuio->generation++;
+    pTuio->timetag = 0;
+
+    if (pTuio->decoder == DECODER_NATIVE) {
+        /* Decode the datagram in place */
+        TuioOscDecode(pInfo, packet->data, packet->len);
+    } else {
+        /* liblo will parse the message and call the appropriate
          * handlers (i.e. _tuio_lo_cur2d_hande()) */
-        lo_server_recv_noblock(pTuio->server, 0);
-
-        /* During the processing of the previous message/bundle,
-         * any "active" messages will be handled by flagging
-         * the listed object ids.  Now that processing is done,
-         * remove any dead object ids and set any pending changes.
-         * Also check to make sure the processed data was newer than
-         * the last processed data */
-        if (pTuio->processed &&
-            (pTuio->fseq_new > pTuio->fseq_old ||
-             pTuio->fseq_old - pTuio->fseq_new > pTuio->fseq_threshold)) {
-
-            while (obj != NULL) {
-                if (!obj->alive) {
-                    if (obj->subdev && pTuio->post_button_events) {
-                        /* Post button "up" event */
-                        xf86PostButtonEvent(obj->subdev->pInfo->dev, TRUE, 1, FALSE, 0, 0);
-                    }
-                    valuators[0] = obj->xpos * 0x7FFFFFFF;
-                    valuators[1] = obj->ypos * 0x7FFFFFFF;
-                    valuators[2] = obj->xvel * 0x7FFFFFFF;
-                    valuators[3] = obj->yvel * 0x7FFFFFFF;
-                    valuator_mask_set_range(vmask,0,NUM_VALUATORS,valuators);
+        lo_server_dispatch_data(pTuio->server, packet->data, packet->len);
+    }
+    TuioHistogramAdd(&pTuio->decode_latency, TuioTime() - wakeup);
+    time = _tuio_frame_time(pTuio, packet);
+
+    /* During the processing of the previous message/bundle,
+     * any "alive" messages will be handled by stamping
+     * the listed object ids.  Now that processing is done,
+     * remove any unstamped object ids and set any pending changes.
+     * Also check to make sure the processed data was newer than
+     * the last processed data, separately for each profile.  A TUIO 2.0
+     * frame may have switched to the source it names. */
+    source = pTuio->source;
+    accept = 0;
+    for (p = 0; p < NUM_TUIO1_PROFILES; p++) {
+        if ((pTuio->processed & (1 << p)) &&
+            (source->fseq_new[p] > source->fseq_old[p] ||
+             source->fseq_old[p] - source->fseq_new[p] > pTuio->fseq_threshold))
+            accept |= 1 << p;
+    }
+    if (pTuio->frame_accept)
+        accept |= pTuio->processed & TUIO2_PROFILES;
 
-                    xf86PostTouchEvent(pInfo->dev,obj->id,XI_TouchEnd,0,vmask);
+    if (pTuio->processed) {
+        if (accept)
+            TuioCount(pTuio, bundles, 1);
+        if (pTuio->processed & ~accept)
+            TuioCount(pTuio, stale, 1);
 
-                    //xf86PostMotionEventP(obj->subdev->pInfo->dev,
+        obj = objects->head;
+        while (obj != NULL) {
+            if (!(pTuio->processed & (1 << obj->profile)) ||
+                obj->source != source - pTuio->sources) {
+                /* Frame didn't contain this profile, or the object
+                 * belongs to another sender */
+                obj = obj->next;
+            } else if (!(accept & (1 << obj->profile))) {
+                /* Frame arrived out of order, forget what it set.  Objects
+                 * it created have not begun and are dropped again. */
+                obj->pending.set = False;
+                objtmp = obj->next;
+                if (obj->pending.button)
+                    _object_release(pInfo, obj);
+                obj = objtmp;
+            } else if (obj->alive != pTuio->generation &&
+                       (pTuio->alive_seen & (1 << obj->profile))) {
+                objtmp = obj->next;
+                _object_end(pInfo, obj);
+                obj = objtmp;
+            } else {
+                /* Object is alive.  Check to see if an update has been set,
+                 * and if so send the event.  Touches are posted on the core
+                 * device whether or not the object has a subdevice. */
+                if (obj->alive == pTuio->generation)
+                    obj->seen = packet->time;
+                if (obj->pending.set) {
+                    /* Senders that leave out velocities get them
+                     * derived from the positions */
+                    if (obj->pending.xvel == 0 && obj->pending.yvel == 0)
+                        _object_derive_velocity(obj, time);
+                    obj->time = time;
+                    obj->xpos = obj->pending.xpos;
+                    obj->ypos = obj->pending.ypos;
+                    obj->xvel = obj->pending.xvel;
+                    obj->yvel = obj->pending.yvel;
+                    reshaped = obj->profile != PROFILE_2DCUR &&
+                        memcmp(&obj->shape, &obj->pending.shape,
+                               sizeof(ShapeRec)) != 0;
+                    if (obj->profile != PROFILE_2DCUR)
+                        obj->shape = obj->pending.shape;
+                    obj->pending.set = False;
+
+                    /* Work out the position to post */
+                    obj->post_x = obj->xpos;
+                    obj->post_y = obj->ypos;
+                    if (pTuio->filter_min_cutoff > 0)
+                        TuioFilterUpdate(pTuio, obj);
+                    if (pTuio->predict_horizon)
+                        TuioPredictUpdate(pTuio, obj);
+
+                    /* OKAY FOR NOW, maybe update with a better range? */
+                    /* TODO: Add more valuators with additional information */
+			
+                    //(xf86PostMotionEventP(obj->subdev->pInfo->dev,
                     //        TRUE, /* is_absolute */
                     //        0, /* first_valuator */
                     //        NUM_VALUATORS, /* num_valuators */
-                    //       valuators);
-
-                    objtmp = obj->next;
-                    obj = _object_remove(obj_list, obj->id);
-                    _subdev_add(pInfo, obj->subdev);
-                    free(obj);
-                    obj = objtmp;
-
-
-                } else {
-                    /* Object is alive.  Check to see if an update has been set.
-                     * If it has been updated and it has a subdevice to send
-                     * events on, send the event) */
-                    if (obj->pending.set && obj->subdev) {
-                        obj->xpos = obj->pending.xpos;
-                        obj->ypos = obj->pending.ypos;
-                        obj->xvel = obj->pending.xvel;
-                        obj->yvel = obj->pending.yvel;
-                        obj->pending.set = False;
-
-                        /* OKAY FOR NOW, maybe update with a better range? */
-                        /* TODO: Add more valuators with additional information */
-                        valuators[0] = obj->xpos * 0x7FFFFFFF;
-                        valuators[1] = obj->ypos * 0x7FFFFFFF;
-                        valuators[2] = obj->xvel * 0x7FFFFFFF;
-                        valuators[3] = obj->yvel * 0x7FFFFFFF;
-			valuator_mask_set_range(vmask,0,NUM_VALUATORS,valuators);
-			
-                        //(xf86PostMotionEventP(obj->subdev->pInfo->dev,
-                        //        TRUE, /* is_absolute */
-                        //        0, /* first_valuator */
-                        //        NUM_VALUATORS, /* num_valuators */
-                        //        valuators);
-                        
+                    //        valuators);
+                    
 			//Object is new to screen and should be added
-                        if (obj->pending.button) {
-                          //  xf86PostButtonEvent(obj->subdev->pInfo->dev, TRUE, 1, TRUE, 0, 0);
-				xf86PostTouchEvent(pInfo->dev,obj->id,XI_TouchBegin,0,vmask);
-                            obj->pending.button = False;
-                        }else {
-				xf86PostTouchEvent(pInfo->dev,obj->id,XI_TouchUpdate,0,vmask);
+                    if (obj->pending.button) {
+                      //  xf86PostButtonEvent(obj->subdev->pInfo->dev, TRUE, 1, TRUE, 0, 0);
+				_tuio_post_touch(pInfo, obj, XI_TouchBegin);
+                        TuioCount(pTuio, born, 1);
+                        obj->pending.button = False;
+                    } else if (!reshaped && _object_in_dead_zone(pTuio, obj)) {
+                        /* Not worth an event */
+                        TuioCount(pTuio, suppressed, 1);
+                    } else if (pTuio->coalesce) {
+                        /* Defer until the socket is drained, replacing
+                         * any update already waiting */
+                        if (obj->pending.update)
+                            pTuio->coalesced_updates++;
+                        obj->pending.update = True;
+                    }else {
+				_tuio_post_touch(pInfo, obj, XI_TouchUpdate);
 			}
 
-                    }
-                    obj->alive = 0; /* Reset for next message */
-                    obj = obj->next;
                 }
+                obj = obj->next;
             }
-            pTuio->fseq_old = pTuio->fseq_new;
         }
+        for (p = 0; p < NUM_TUIO1_PROFILES; p++) {
+            if (accept & (1 << p))
+                source->fseq_old[p] = source->fseq_new[p];
+        }
+    }
+
+    /* While coalescing, events are only posted once the socket is
+     * drained */
+    if (!pTuio->coalesce)
+        _tuio_frame_done(pTuio, wakeup);
+}
+
+/**
+ * @return the time of the current frame in ns: the sender's timetag if it
+ * has one, otherwise the time the datagram was received.  Times are only
+ * ever compared between frames of the same source.
+ */
+static inline unsigned long long
+_tuio_frame_time(TuioDevicePtr pTuio, PacketPtr packet)
+{
+    unsigned long long timetag = pTuio->timetag;
+
+    /* 0 and 1 both mean "immediately" */
+    if (timetag <= 1)
+        return packet->time;
+
+    return (timetag >> 32) * 1000000000 +
+        (((timetag & 0xFFFFFFFF) * 1000000000) >> 32);
+}
+
+/**
+ * Sets the pending velocity of an object from its last and pending
+ * positions, in units per second like TUIO's.  Left at zero for the first
+ * update, or if the last one was too long ago to tell.
+ */
+static inline void
+_object_derive_velocity(ObjectPtr obj, unsigned long long time)
+{
+    float dt;
+
+    if (obj->time == 0 || time <= obj->time ||
+        time - obj->time > MAX_VELOCITY_INTERVAL)
+        return;
+
+    dt = (time - obj->time) / 1e9f;
+    obj->pending.xvel = (obj->pending.xpos - obj->xpos) / dt;
+    obj->pending.yvel = (obj->pending.ypos - obj->ypos) / dt;
+
+    /* Keep within the range of the velocity axes */
+    obj->pending.xvel = fmaxf(-1.0f, fminf(1.0f, obj->pending.xvel));
+    obj->pending.yvel = fmaxf(-1.0f, fminf(1.0f, obj->pending.yvel));
+}
+
+/**
+ * @return True if the position to post for an object is within DeadZone
+ * of the one last posted
+ */
+static inline Bool
+_object_in_dead_zone(TuioDevicePtr pTuio, ObjectPtr obj)
+{
+    return pTuio->dead_zone > 0 &&
+        hypotf(obj->post_x - obj->posted_x,
+               obj->post_y - obj->posted_y) < pTuio->dead_zone;
+}
+
+/**
+ * Fill the device's valuator mask with the current state of an object, at
+ * its filtered and predicted position, or if raw is set, at the position
+ * last reported.  Positions are calibrated last.
+ */
+static inline void
+_object_set_valuators(TuioDevicePtr pTuio, ObjectPtr obj, Bool raw)
+{
+    ValuatorMask *vmask = pTuio->vmask;
+    int *valuators = pTuio->valuators;
+    float x, y;
+
+    if (raw) {
+        x = obj->xpos;
+        y = obj->ypos;
+    } else {
+        x = obj->posted_x = obj->post_x;
+        y = obj->posted_y = obj->post_y;
+    }
+    TuioCalibrate(&pTuio->calibration, x, y, valuators);
+    valuators[2] = obj->xvel * 0x7FFFFFFF;
+    valuators[3] = obj->yvel * 0x7FFFFFFF;
+
+    if (obj->profile == PROFILE_2DCUR) {
+        /* Only clear the mask if the last object used the extra axes */
+        if (pTuio->vmask_extra) {
+            valuator_mask_zero(vmask);
+            pTuio->vmask_extra = False;
+        }
+        valuator_mask_set_range(vmask, 0, NUM_CURSOR_VALUATORS, valuators);
+        return;
+    }
+
+    valuator_mask_zero(vmask);
+    pTuio->vmask_extra = True;
+    valuators[VAL_ANGLE] = obj->shape.angle / (2 * M_PI) * 0x7FFFFFFF;
+    valuator_mask_set_range(vmask, 0, VAL_ANGLE + 1, valuators);
+
+    switch (obj->profile) {
+        case PROFILE_PTR:
+            valuator_mask_set(vmask, VAL_PRESSURE,
+                              obj->shape.pressure * 0x7FFFFFFF);
+            /* fall through */
+        case PROFILE_2DBLB:
+            valuator_mask_set(vmask, VAL_WIDTH,
+                              obj->shape.width * 0x7FFFFFFF);
+            valuator_mask_set(vmask, VAL_HEIGHT,
+                              obj->shape.height * 0x7FFFFFFF);
+            break;
+        default: /* 2Dobj and tok */
+            valuator_mask_set(vmask, VAL_FIDUCIAL, obj->shape.class_id);
+            break;
     }
-    valuator_mask_free(&vmask);
 }
 
 /**
@@ -394,7 +1016,6 @@ TuioControl(DeviceIntPtr device,
     InputInfoPtr pInfo = device->public.devicePrivate;
     TuioDevicePtr pTuio = pInfo->private;
     SubDevicePtr subdev;
-    char *tuio_port;
     int res;
 
     switch (what)
@@ -407,6 +1028,16 @@ TuioControl(DeviceIntPtr device,
             /* If this is a "core" device, create object devices */
             if (pTuio) {
                // _hal_create_devices(pInfo, pTuio->init_num_subdev); //TODO:Kill HAL completely
+
+                /* Valuator mask reused for every event posted */
+                pTuio->vmask = valuator_mask_new(NUM_VALUATORS);
+                if (pTuio->vmask == NULL) {
+                    xf86Msg(X_ERROR, "%s: Failed to allocate valuator mask\n",
+                            pInfo->name);
+                    return BadAlloc;
+                }
+
+                TuioPropertyInit(device);
             }
             break;
 
@@ -432,30 +1063,59 @@ TuioControl(DeviceIntPtr device,
                 goto finish;
             }
 
+            if (pTuio->decoder == DECODER_NATIVE) {
+                /* liblo isn't needed, open the socket directly */
+                pTuio->socket_fd = TuioNetOpen(pInfo, pTuio->tuio_port);
+                if (pTuio->socket_fd < 0)
+                    return BadAlloc;
+                if (TuioNetPublish(pInfo) < 0) {
+                    TuioNetDiscard(pInfo, pTuio->socket_fd);
+                    pTuio->socket_fd = -1;
+                    return BadAlloc;
+                }
+                goto flush;
+            }
+
             /* Setup server */
-            asprintf(&tuio_port, "%i", pTuio->tuio_port);
-            pTuio->server = lo_server_new_with_proto(tuio_port, LO_UDP, _lo_error);
-            if (pTuio->server == NULL) {
-                xf86Msg(X_ERROR, "%s: Error allocating new lo_server\n", 
-                        pInfo->name);
+            pTuio->server = _tuio_lo_server_new(pInfo, pTuio->tuio_port);
+            if (pTuio->server == NULL)
                 return BadAlloc;
-            }
+            pTuio->socket_fd = lo_server_get_socket_fd(pTuio->server);
+
+flush:
+            xf86FlushInput(pTuio->socket_fd);
+            TuioNetSetup(pInfo, pTuio->socket_fd);
+            pTuio->socket_drops = 0;
+            pInfo->fd = pTuio->socket_fd;
 
-            /* Register to receive all /tuio/2Dcur messages */
-            lo_server_add_method(pTuio->server, "/tuio/2Dcur", NULL, 
-                                 _tuio_lo_2dcur_handle, pInfo);
+            /* Recording is optional, carry on without it on error */
+            if (pTuio->record_file != NULL)
+                pTuio->recorder = TuioRecordOpen(pInfo, pTuio->record_file);
 
-            pInfo->fd = lo_server_get_socket_fd(pTuio->server);
+            /* If the thread can't be started, receive in the input
+             * handler instead */
+            if (pTuio->threaded)
+                pTuio->thread = TuioThreadStart(pInfo);
 
-            xf86FlushInput(pInfo->fd);
+            if (pTuio->watchdog.timeout)
+                pTuio->watchdog_timer = TimerSet(pTuio->watchdog_timer, 0,
+                        _tuio_watchdog_interval(pTuio),
+                        _tuio_watchdog_timeout, pInfo);
 
 finish:     xf86AddEnabledDevice(pInfo);
             device->public.on = TRUE;
 
-            /* Allocate device storage and add to device list */
-            subdev = malloc(sizeof(SubDeviceRec));
+            /* Take device storage from the pool and add to device list */
+            subdev = _subdev_alloc(g_pInfo->private);
+            if (subdev == NULL) {
+                xf86Msg(X_ERROR, "%s: No subdevice storage left\n",
+                        pInfo->name);
+                break;
+            }
             subdev->pInfo = pInfo;
+            _subdev_lock(g_pInfo, True);
             _subdev_add(g_pInfo, subdev);
+            _subdev_lock(g_pInfo, False);
             break;
 
         case DEVICE_OFF:
@@ -466,12 +1126,38 @@ finish:     xf86AddEnabledDevice(pInfo);
             xf86RemoveEnabledDevice(pInfo);
 
             if (pTuio) {
-                lo_server_free(pTuio->server);
+                TimerCancel(pTuio->rebind_timer);
+                TimerCancel(pTuio->watchdog_timer);
+                pTuio->rebind_expired = False;
+                pTuio->watchdog_due = False;
+                if (pTuio->thread != NULL) {
+                    TuioThreadStop(pInfo, pTuio->thread);
+                    pTuio->thread = NULL;
+                }
+                xf86Msg(X_INFO, "%s: %lu packets in %lu wakeups, "
+                        "%lu receive calls, %lu updates coalesced\n",
+                        pInfo->name, pTuio->counters.packets,
+                        pTuio->wakeups, pTuio->recv_calls,
+                        pTuio->coalesced_updates);
+                if (pTuio->recorder != NULL) {
+                    TuioRecordClose(pInfo, pTuio->recorder);
+                    pTuio->recorder = NULL;
+                }
+                _tuio_rebind_discard(pInfo);
+                /* No socket is left if a rebind failed */
+                if (pTuio->decoder == DECODER_NATIVE)
+                    TuioNetClose(pInfo, pTuio->socket_fd);
+                else if (pTuio->server != NULL)
+                    lo_server_free(pTuio->server);
+                pTuio->server = NULL;
+                pTuio->socket_fd = -1;
                 pInfo->fd = -1;
             }
             /* Remove subdev from list - This applies for both subdevices
              * and the "core" device */
+            _subdev_lock(g_pInfo, True);
             _subdev_remove(g_pInfo, pInfo);
+            _subdev_lock(g_pInfo, False);
 
             device->public.on = FALSE;
             break;
@@ -479,6 +1165,14 @@ finish:     xf86AddEnabledDevice(pInfo);
         case DEVICE_CLOSE:
             xf86Msg(X_INFO, "%s: Close\n", pInfo->name);
             //_hal_remove_device(pInfo); TODO: hal bad
+            if (pTuio && pTuio->vmask)
+                valuator_mask_free(&pTuio->vmask);
+            if (pTuio) {
+                TimerFree(pTuio->rebind_timer);
+                TimerFree(pTuio->watchdog_timer);
+                pTuio->rebind_timer = NULL;
+                pTuio->watchdog_timer = NULL;
+            }
             break;
 
     }
@@ -486,113 +1180,789 @@ finish:     xf86AddEnabledDevice(pInfo);
 }
 
 /**
- * Initialize the device properties
- * TODO
+ * Keeps the input handler from running, on servers that run it from a
+ * signal handler or an input thread.  With a receive thread, its lock is
+ * taken first, see thread.c.
  */
-TuioPropertyInit() {
+static inline int
+_block_input(void)
+{
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 23
+    input_lock();
+    return 0;
+#else
+    return xf86BlockSIGIO();
+#endif
+}
+
+static inline void
+_unblock_input(int state)
+{
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 23
+    input_unlock();
+#else
+    xf86UnblockSIGIO(state);
+#endif
 }
 
 /**
- * Free a TuioDeviceRec
+ * Sets a flag for _tuio_process_due() and has it run on the side that
+ * owns the objects: in the receive thread if there is one, or here with
+ * input blocked.  Timers may run with input already blocked, so the
+ * thread's lock is not taken.
  */
 static void
-_free_tuiodev(TuioDevicePtr pTuio) {
-    ObjectPtr obj = pTuio->obj_list;
-    ObjectPtr tmp;
+_tuio_schedule(InputInfoPtr pInfo, Bool *flag)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    int state;
 
-    while (obj != NULL) {
-        tmp = obj->next;
-        free(obj);
-        obj = tmp;
+    if (pTuio->thread != NULL) {
+        __atomic_store_n(flag, True, __ATOMIC_RELEASE);
+        TuioThreadWake(pTuio->thread);
+        return;
     }
 
-    free(pTuio);
+    state = _block_input();
+    *flag = True;
+    _tuio_process_due(pInfo, TuioTime());
+    _unblock_input(state);
 }
 
 /**
- * Handles OSC messages in the /tuio/2Dcur address space
+ * Ends the objects not confirmed since the last rebind
+ */
+static CARD32
+_tuio_rebind_timeout(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    InputInfoPtr pInfo = arg;
+    TuioDevicePtr pTuio = pInfo->private;
+
+    _tuio_schedule(pInfo, &pTuio->rebind_expired);
+    return 0;
+}
+
+/**
+ * @return the interval of the watchdog timer in ms, one wheel tick
+ */
+static inline CARD32
+_tuio_watchdog_interval(TuioDevicePtr pTuio)
+{
+    return (pTuio->watchdog.tick + 999999) / 1000000;
+}
+
+/**
+ * Advances the watchdog, every wheel tick
+ */
+static CARD32
+_tuio_watchdog_timeout(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    InputInfoPtr pInfo = arg;
+    TuioDevicePtr pTuio = pInfo->private;
+
+    _tuio_schedule(pInfo, &pTuio->watchdog_due);
+    return _tuio_watchdog_interval(pTuio);
+}
+
+/**
+ * Keeps frames from being processed, so that the state they use can be
+ * changed between them: takes the receive thread's lock if it runs, then
+ * blocks input
+ *
+ * @return the state to pass to TuioUnlockFrames()
+ */
+int
+TuioLockFrames(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    if (pTuio->thread != NULL)
+        TuioThreadLock(pTuio->thread);
+    return _block_input();
+}
+
+void
+TuioUnlockFrames(InputInfoPtr pInfo, int state)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    _unblock_input(state);
+    if (pTuio->thread != NULL)
+        TuioThreadUnlock(pTuio->thread);
+}
+
+/**
+ * Changes ContactTimeout, in ms, 0 to stop watching.  The objects owned
+ * by a receive thread are only touched between frames.
+ */
+void
+TuioSetContactTimeout(InputInfoPtr pInfo, int timeout)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    int state;
+
+    if (pTuio->thread != NULL)
+        TuioThreadLock(pTuio->thread);
+    state = _block_input();
+    TuioWatchdogSetTimeout(pTuio, timeout * 1000000ULL);
+    __atomic_store_n(&pTuio->watchdog_due, False, __ATOMIC_RELAXED);
+    _unblock_input(state);
+    if (pTuio->thread != NULL)
+        TuioThreadUnlock(pTuio->thread);
+
+    if (!pInfo->dev->public.on)
+        return;
+    if (timeout)
+        pTuio->watchdog_timer = TimerSet(pTuio->watchdog_timer, 0,
+                                         _tuio_watchdog_interval(pTuio),
+                                         _tuio_watchdog_timeout, pInfo);
+    else
+        TimerCancel(pTuio->watchdog_timer);
+}
+
+/**
+ * Closes the socket left by a TuioRebindPrepare() that no TuioRebind()
+ * followed
+ */
+static void
+_tuio_rebind_discard(InputInfoPtr pInfo)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    if (pTuio->rebind_server != NULL)
+        lo_server_free(pTuio->rebind_server);
+    else if (pTuio->rebind_fd >= 0)
+        TuioNetDiscard(pInfo, pTuio->rebind_fd);
+    pTuio->rebind_server = NULL;
+    pTuio->rebind_fd = -1;
+}
+
+/**
+ * Opens a socket on port with the decoder in use
+ *
+ * @return the socket, or -1 on error.  With liblo, its server is stored
+ * in server.
  */
 static int
-_tuio_lo_2dcur_handle(const char *path,
-                      const char *types,
-                      lo_arg **argv,
-                      int argc,
-                      void *data,
-                      void *user_data) {
-    InputInfoPtr pInfo = user_data;
+_tuio_rebind_open(InputInfoPtr pInfo, int port, lo_server *server)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    *server = NULL;
+    if (pTuio->decoder == DECODER_NATIVE)
+        return TuioNetOpen(pInfo, port);
+    *server = _tuio_lo_server_new(pInfo, port);
+    return *server != NULL ? lo_server_get_socket_fd(*server) : -1;
+}
+
+/**
+ * Opens the socket that TuioRebind() moves the listener of an enabled
+ * device to, when setting the port is checked, so that a port that can't
+ * be bound is refused before anything changes.  The socket is kept until
+ * the port is set, or replaced if another port is checked first.  The
+ * UDP port in use can't be bound a second time, so the socket for it is
+ * only opened by TuioRebind().
+ *
+ * @return Success, or BadValue if the socket could not be opened
+ */
+int
+TuioRebindPrepare(InputInfoPtr pInfo, int port)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    lo_server server;
+    int fd;
+
+    _tuio_rebind_discard(pInfo);
+    if (!pInfo->dev->public.on ||
+        (pTuio->socket_path == NULL && port == pTuio->tuio_port))
+        return Success;
+
+    fd = _tuio_rebind_open(pInfo, port, &server);
+    if (fd < 0)
+        return BadValue;
+
+    pTuio->rebind_fd = fd;
+    pTuio->rebind_server = server;
+    pTuio->rebind_port = port;
+    return Success;
+}
+
+/**
+ * Moves the listener of an enabled device to the socket opened by
+ * TuioRebindPrepare() for port, without disabling the device.  Setting
+ * the UDP port in use closes its socket and then binds the port again,
+ * between frames; if that fails, nothing is received until the port is
+ * set again.  Live objects are kept; those that no frame confirms within
+ * REBIND_TIMEOUT are ended.  A disabled device just uses port the next
+ * time it is enabled.
+ *
+ * @return Success, or BadValue if there is no socket for port
+ */
+int
+TuioRebind(InputInfoPtr pInfo, int port)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    lo_server server = NULL, old_server;
+    int fd = -1, old_fd, state;
+    Bool reopen;
+
+    if (!pInfo->dev->public.on) {
+        pTuio->tuio_port = port;
+        return Success;
+    }
+
+    reopen = pTuio->socket_path == NULL && port == pTuio->tuio_port;
+    if (!reopen) {
+        if ((pTuio->rebind_fd < 0 || pTuio->rebind_port != port) &&
+            TuioRebindPrepare(pInfo, port) != Success)
+            return BadValue;
+        fd = pTuio->rebind_fd;
+        server = pTuio->rebind_server;
+        pTuio->rebind_fd = -1;
+        pTuio->rebind_server = NULL;
+
+        if (TuioNetPublish(pInfo) < 0) {
+            TuioNetDiscard(pInfo, fd);
+            return BadValue;
+        }
+        TuioNetSetup(pInfo, fd);
+    }
+
+    /* Swap the sockets between frames, with the receive thread out of
+     * poll(), where it would keep the old socket and its port open */
+    if (pTuio->thread != NULL)
+        TuioThreadHold(pTuio->thread);
+    state = _block_input();
+    old_fd = pTuio->socket_fd;
+    old_server = pTuio->server;
+    if (reopen) {
+        if (old_server != NULL)
+            lo_server_free(old_server);
+        else if (old_fd >= 0)
+            close(old_fd);
+        old_fd = -1;
+        old_server = NULL;
+        fd = _tuio_rebind_open(pInfo, port, &server);
+        if (fd >= 0)
+            TuioNetSetup(pInfo, fd);
+    }
+    pTuio->socket_fd = fd;
+    pTuio->socket_drops = 0;
+    pTuio->server = server;
+    pTuio->tuio_port = port;
+    pTuio->rebind_generation = pTuio->generation;
+    __atomic_store_n(&pTuio->rebind_expired, False, __ATOMIC_RELAXED);
+    if (pTuio->thread == NULL) {
+        if (pInfo->fd >= 0)
+            xf86RemoveEnabledDevice(pInfo);
+        pInfo->fd = fd;
+        if (fd >= 0)
+            xf86AddEnabledDevice(pInfo);
+    }
+    _unblock_input(state);
+    if (pTuio->thread != NULL)
+        TuioThreadResume(pTuio->thread);
+
+    if (old_server != NULL)
+        lo_server_free(old_server);
+    else if (old_fd >= 0)
+        close(old_fd);
+
+    if (fd < 0) {
+        xf86Msg(X_ERROR, "%s: Not receiving until TUIO Port is set again\n",
+                pInfo->name);
+        return BadValue;
+    }
+
+    pTuio->rebind_timer = TimerSet(pTuio->rebind_timer, 0, REBIND_TIMEOUT,
+                                   _tuio_rebind_timeout, pInfo);
+    if (pTuio->socket_path != NULL)
+        xf86Msg(X_INFO, "%s: Reopened %s\n", pInfo->name,
+                pTuio->socket_path);
+    else
+        xf86Msg(X_INFO, "%s: Rebound to UDP port %i\n", pInfo->name, port);
+
+    return Success;
+}
+
+/**
+ * Free a TuioDeviceRec
+ */
+static void
+_free_tuiodev(TuioDevicePtr pTuio) {
+    int i;
+
+    for (i = 0; i < pTuio->num_source_configs; i++)
+        free(pTuio->source_configs[i].name);
+    free(pTuio->record_file);
+    free(pTuio->socket_path);
+    free(pTuio->listen_address);
+    free(pTuio->listen_interface);
+    TuioObjectTableFree(&pTuio->objects);
+    free(pTuio->obj_pool);
+    free(pTuio->recv_buf);
+    free(pTuio);
+}
+
+/**
+ * Handles the messages common to all TUIO 1.1 profiles, and checks the
+ * first argument of every message.
+ *
+ * @return True if the message was a "set" message that still needs to be
+ * handled by the profile
+ */
+static Bool
+_tuio_lo_common(InputInfoPtr pInfo,
+                int profile,
+                const char *path,
+                const char *types,
+                lo_arg **argv,
+                int argc,
+                lo_message msg) {
     TuioDevicePtr pTuio = pInfo->private;
-    ObjectPtr *obj_list = &pTuio->obj_list;
-    ObjectPtr obj, objtemp;
-    char *act;
+    lo_timetag timetag;
     int i;
 
     if (argc == 0) {
-        xf86Msg(X_ERROR, "%s: Error in /tuio/cur2d (argc == 0)\n", 
-                pInfo->name);
-        return 0;
+        TuioLogMalformed(pInfo, "Error in %s (argc == 0)\n",
+                         path);
+        return False;
     } else if(*types != 's') {
-        xf86Msg(X_ERROR, "%s: Error in /tuio/cur2d (types[0] != 's')\n", 
-                pInfo->name);
-        return 0;
+        TuioLogMalformed(pInfo, "Error in %s (types[0] != 's')\n",
+                         path);
+        return False;
     }
 
     /* Flag as being processed, used in TuioReadInput() */
-    pTuio->processed = 1;
+    pTuio->processed |= 1 << profile;
+
+    /* Messages of a bundle carry its timetag */
+    timetag = lo_message_get_timestamp(msg);
+    pTuio->timetag = (unsigned long long)timetag.sec << 32 | timetag.frac;
 
     /* Parse message type */
     /* Set message type:  */
     if (strcmp((char *)argv[0], "set") == 0) {
+        return True;
+
+    } else if (strcmp((char *)argv[0], "alive") == 0) {
+        pTuio->alive_seen |= 1 << profile;
+        for (i=1; i<argc; i++)
+            TuioAlive(pTuio, argv[i]->i);
 
+    } else if (strcmp((char *)argv[0], "fseq") == 0) {
         /* Simple type check */
-        if (strcmp(types, "sifffff")) {
-            xf86Msg(X_ERROR, "%s: Error in /tuio/cur2d set msg (types == %s)\n", 
-                    pInfo->name, types);
-            return 0;
+        if (strcmp(types, "si")) {
+            TuioLogMalformed(pInfo, "Error in %s fseq msg (types == %s)\n",
+                             path, types);
+            return False;
         }
+        pTuio->source->fseq_new[profile] = argv[1]->i;
 
-        obj = _object_get(*obj_list, argv[1]->i);
+    }
+    return False;
+}
 
-        /* If not found, create a new object */
-        if (obj == NULL) {
-            obj = _object_new(argv[1]->i);
-            _object_add(obj_list, obj);
-            obj->subdev = _subdev_get(pInfo, &pTuio->subdev_list);
-            if (obj->subdev && pTuio->post_button_events)
-                obj->pending.button = True;
-        }
+/**
+ * Handles OSC messages in the /tuio/2Dcur address space
+ */
+static int
+_tuio_lo_2dcur_handle(const char *path,
+                      const char *types,
+                      lo_arg **argv,
+                      int argc,
+                      void *data,
+                      void *user_data) {
+    InputInfoPtr pInfo = user_data;
 
-        obj->pending.xpos = argv[2]->f;
-        obj->pending.ypos = argv[3]->f;
-        obj->pending.xvel = argv[4]->f;
-        obj->pending.yvel = argv[5]->f;
-        obj->pending.set = True;
+    if (!_tuio_lo_common(pInfo, PROFILE_2DCUR, path, types, argv, argc,
+                         data))
+        return 0;
 
-    } else if (strcmp((char *)argv[0], "alive") == 0) {
-        /* Mark all objects that are still alive */
-        obj = *obj_list;
-        while (obj != NULL) {
-            for (i=1; i<argc; i++) {
-                if (argv[i]->i == obj->id) {
-                    obj->alive = True;
-                    break;
-                }
-            }
-            obj = obj->next;
-        }
+    /* Simple type check */
+    if (strcmp(types, "sifffff")) {
+        TuioLogMalformed(pInfo, "Error in /tuio/cur2d set msg (types == %s)\n",
+                         types);
+        return 0;
+    }
 
-    } else if (strcmp((char *)argv[0], "fseq") == 0) {
-        /* Simple type check */
-        if (strcmp(types, "si")) {
-            xf86Msg(X_ERROR, "%s: Error in /tuio/cur2d fseq msg (types == %s)\n", 
-                    pInfo->name, types);
+    TuioCursorSet(pInfo, argv[1]->i, argv[2]->f, argv[3]->f,
+                  argv[4]->f, argv[5]->f);
+
+    return 0;
+}
+
+/**
+ * Handles OSC messages in the /tuio/2Dobj address space
+ */
+static int
+_tuio_lo_2dobj_handle(const char *path,
+                      const char *types,
+                      lo_arg **argv,
+                      int argc,
+                      void *data,
+                      void *user_data) {
+    InputInfoPtr pInfo = user_data;
+
+    if (!_tuio_lo_common(pInfo, PROFILE_2DOBJ, path, types, argv, argc,
+                         data))
+        return 0;
+
+    /* set s i x y a X Y A m r */
+    if (strcmp(types, "siiffffffff")) {
+        TuioLogMalformed(pInfo, "Error in /tuio/2Dobj set msg (types == %s)\n",
+                         types);
+        return 0;
+    }
+
+    TuioFiducialSet(pInfo, argv[1]->i, argv[2]->i, argv[3]->f, argv[4]->f,
+                    argv[5]->f, argv[6]->f, argv[7]->f);
+
+    return 0;
+}
+
+/**
+ * Handles OSC messages in the /tuio/2Dblb address space
+ */
+static int
+_tuio_lo_2dblb_handle(const char *path,
+                      const char *types,
+                      lo_arg **argv,
+                      int argc,
+                      void *data,
+                      void *user_data) {
+    InputInfoPtr pInfo = user_data;
+
+    if (!_tuio_lo_common(pInfo, PROFILE_2DBLB, path, types, argv, argc,
+                         data))
+        return 0;
+
+    /* set s x y a w h f X Y A m r */
+    if (strcmp(types, "sifffffffffff")) {
+        TuioLogMalformed(pInfo, "Error in /tuio/2Dblb set msg (types == %s)\n",
+                         types);
+        return 0;
+    }
+
+    TuioBlobSet(pInfo, argv[1]->i, argv[2]->f, argv[3]->f, argv[4]->f,
+                argv[5]->f, argv[6]->f, argv[7]->f, argv[8]->f, argv[9]->f);
+
+    return 0;
+}
+
+/**
+ * Handles /tuio2/frm messages, which start every TUIO 2.0 bundle
+ */
+static int
+_tuio_lo_frm_handle(const char *path,
+                    const char *types,
+                    lo_arg **argv,
+                    int argc,
+                    void *data,
+                    void *user_data) {
+    InputInfoPtr pInfo = user_data;
+    TuioDevicePtr pTuio = pInfo->private;
+
+    /* frm f_id time dim source */
+    if (argc < 2 || types[0] != 'i' || types[1] != 't') {
+        TuioLogMalformed(pInfo, "Error in /tuio2/frm msg (types == %s)\n",
+                         types);
+        return 0;
+    }
+
+    TuioFrame(pTuio, argv[0]->i, argv[1]->t.sec, argv[1]->t.frac,
+              argc >= 4 && types[3] == 's' ? &argv[3]->s : NULL);
+    return 0;
+}
+
+/**
+ * Handles /tuio2/ptr messages
+ */
+static int
+_tuio_lo_ptr_handle(const char *path,
+                    const char *types,
+                    lo_arg **argv,
+                    int argc,
+                    void *data,
+                    void *user_data) {
+    InputInfoPtr pInfo = user_data;
+    Bool vel;
+
+    /* ptr s_id tu_id c_id x y a shear radius press [X Y P m p] */
+    vel = strcmp(types, "iiifffffffffff") == 0;
+    if (!vel && strcmp(types, "iiiffffff")) {
+        TuioLogMalformed(pInfo, "Error in /tuio2/ptr msg (types == %s)\n",
+                         types);
+        return 0;
+    }
+
+    TuioPointerSet(pInfo, argv[0]->i, argv[3]->f, argv[4]->f, argv[5]->f,
+                   argv[6]->f, argv[7]->f, argv[8]->f,
+                   vel ? argv[9]->f : 0, vel ? argv[10]->f : 0);
+    return 0;
+}
+
+/**
+ * Handles /tuio2/tok messages
+ */
+static int
+_tuio_lo_tok_handle(const char *path,
+                    const char *types,
+                    lo_arg **argv,
+                    int argc,
+                    void *data,
+                    void *user_data) {
+    InputInfoPtr pInfo = user_data;
+    Bool vel;
+
+    /* tok s_id tu_id c_id x y a [X Y A m r] */
+    vel = strcmp(types, "iiiffffffff") == 0;
+    if (!vel && strcmp(types, "iiifff")) {
+        TuioLogMalformed(pInfo, "Error in /tuio2/tok msg (types == %s)\n",
+                         types);
+        return 0;
+    }
+
+    TuioTokenSet(pInfo, argv[0]->i, argv[2]->i, argv[3]->f, argv[4]->f,
+                 argv[5]->f, vel ? argv[6]->f : 0, vel ? argv[7]->f : 0);
+    return 0;
+}
+
+/**
+ * Handles /tuio2/alv messages, which end every TUIO 2.0 bundle
+ */
+static int
+_tuio_lo_alv_handle(const char *path,
+                    const char *types,
+                    lo_arg **argv,
+                    int argc,
+                    void *data,
+                    void *user_data) {
+    InputInfoPtr pInfo = user_data;
+    TuioDevicePtr pTuio = pInfo->private;
+    int i;
+
+    for (i=0; i<argc; i++) {
+        if (types[i] != 'i') {
+            TuioLogMalformed(pInfo, "Error in /tuio2/alv msg (types == %s)\n",
+                             types);
             return 0;
         }
-        pTuio->fseq_new = argv[1]->i;
-
     }
+
+    pTuio->alive_seen |= TUIO2_PROFILES;
+    for (i=0; i<argc; i++)
+        TuioAlive(pTuio, argv[i]->i);
     return 0;
 }
 
+/**
+ * Finds the object for a "set" message, creating it if it is new
+ *
+ * @return NULL if the object could not be created
+ */
+static ObjectPtr
+_object_lookup(InputInfoPtr pInfo, int id, int profile)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+    ObjectTablePtr objects = &pTuio->objects;
+    int source = pTuio->source - pTuio->sources;
+    ObjectPtr obj;
+
+    obj = TuioObjectGet(objects, source, id);
+    if (obj != NULL)
+        return obj;
+
+    /* If not found, create a new object */
+    obj = _object_new(pTuio, source, id);
+    if (obj == NULL) {
+        /* All objects are in use */
+        TuioCount(pTuio, overflow, 1);
+        if (pTuio->overflow_policy != OVERFLOW_EVICT ||
+            objects->head == NULL)
+            return NULL;
+
+        /* The head of the table is the oldest object.  It is ended like
+         * any other, or just released if its touch hasn't begun. */
+        _object_end(pInfo, objects->head);
+        obj = _object_new(pTuio, source, id);
+    }
+    obj->profile = profile;
+    obj->alive = pTuio->generation;
+    obj->seen = TuioTime();
+    TuioObjectAdd(objects, obj);
+    TuioWatchdogAdd(pTuio, obj);
+    pTuio->source->num_objects++;
+    obj->subdev = _subdev_get(pInfo, &pTuio->subdev_list);
+    if (obj->subdev == NULL)
+        TuioCount(pTuio, no_subdev, 1);
+    obj->pending.button = True; /* Touch begins with the first update */
+
+    return obj;
+}
+
+/**
+ * Stores the new position and velocity of an object, mapped into the
+ * region of the device covered by the current source
+ */
+static inline void
+_object_set_motion(TuioDevicePtr pTuio, ObjectPtr obj,
+                   float xpos, float ypos, float xvel, float yvel)
+{
+    SourcePtr source = pTuio->source;
+
+    obj->pending.xpos = source->x + xpos * source->width;
+    obj->pending.ypos = source->y + ypos * source->height;
+    obj->pending.xvel = xvel * source->width;
+    obj->pending.yvel = yvel * source->height;
+}
+
+/**
+ * Applies a 2Dcur "set" message
+ */
+void
+TuioCursorSet(InputInfoPtr pInfo, int id,
+              float xpos, float ypos, float xvel, float yvel)
+{
+    ObjectPtr obj = _object_lookup(pInfo, id, PROFILE_2DCUR);
+
+    if (obj == NULL)
+        return;
+
+    _object_set_motion(pInfo->private, obj, xpos, ypos, xvel, yvel);
+    obj->pending.set = True;
+}
+
+/**
+ * Applies a 2Dobj "set" message
+ */
+void
+TuioFiducialSet(InputInfoPtr pInfo, int id, int class_id,
+                float xpos, float ypos, float angle, float xvel, float yvel)
+{
+    ObjectPtr obj = _object_lookup(pInfo, id, PROFILE_2DOBJ);
+
+    if (obj == NULL)
+        return;
+
+    _object_set_motion(pInfo->private, obj, xpos, ypos, xvel, yvel);
+    obj->pending.shape.class_id = class_id;
+    obj->pending.shape.angle = angle;
+    obj->pending.set = True;
+}
+
+/**
+ * Applies a 2Dblb "set" message
+ */
+void
+TuioBlobSet(InputInfoPtr pInfo, int id, float xpos, float ypos, float angle,
+            float width, float height, float area, float xvel, float yvel)
+{
+    ObjectPtr obj = _object_lookup(pInfo, id, PROFILE_2DBLB);
+
+    if (obj == NULL)
+        return;
+
+    _object_set_motion(pInfo->private, obj, xpos, ypos, xvel, yvel);
+    obj->pending.shape.angle = angle;
+    obj->pending.shape.width = width;
+    obj->pending.shape.height = height;
+    obj->pending.shape.area = area;
+    obj->pending.set = True;
+}
+
+/**
+ * Applies a /tuio2/ptr message.  The pointer's radius is reported as its
+ * width and height.
+ */
+void
+TuioPointerSet(InputInfoPtr pInfo, int id, float xpos, float ypos,
+               float angle, float shear, float radius, float pressure,
+               float xvel, float yvel)
+{
+    ObjectPtr obj = _object_lookup(pInfo, id, PROFILE_PTR);
+
+    if (obj == NULL)
+        return;
+
+    _object_set_motion(pInfo->private, obj, xpos, ypos, xvel, yvel);
+    obj->pending.shape.angle = angle;
+    obj->pending.shape.shear = shear;
+    obj->pending.shape.width = radius * 2;
+    obj->pending.shape.height = radius * 2;
+    obj->pending.shape.pressure = pressure;
+    obj->pending.set = True;
+}
+
+/**
+ * Applies a /tuio2/tok message
+ */
+void
+TuioTokenSet(InputInfoPtr pInfo, int id, int class_id,
+             float xpos, float ypos, float angle, float xvel, float yvel)
+{
+    ObjectPtr obj = _object_lookup(pInfo, id, PROFILE_TOK);
+
+    if (obj == NULL)
+        return;
+
+    _object_set_motion(pInfo->private, obj, xpos, ypos, xvel, yvel);
+    obj->pending.shape.class_id = class_id;
+    obj->pending.shape.angle = angle;
+    obj->pending.set = True;
+}
+
+/**
+ * Applies a /tuio2/frm message.  The frame is accepted if its id is newer
+ * than the last frame's, or if its time is later (i.e. the tracker was
+ * restarted and its frame ids started over).  If the frame names its
+ * source, the rest of the bundle belongs to that source rather than to
+ * the sender's address.
+ */
+void
+TuioFrame(TuioDevicePtr pTuio, unsigned int frame_id,
+          unsigned int sec, unsigned int frac, const char *source)
+{
+    unsigned long long time = (unsigned long long)sec << 32 | frac;
+    SourcePtr named;
+
+    pTuio->processed |= TUIO2_PROFILES;
+
+    if (source != NULL) {
+        named = TuioSourceFromName(pTuio, source);
+        if (named != NULL)
+            pTuio->source = named;
+    }
+
+    /* The frame's own time takes precedence over its bundle's */
+    if (time > 1)
+        pTuio->timetag = time;
+
+    if ((int)(frame_id - pTuio->source->frame_id) > 0 ||
+        time > pTuio->source->frame_time) {
+        pTuio->source->frame_id = frame_id;
+        pTuio->source->frame_time = time;
+        pTuio->frame_accept = True;
+    } else {
+        pTuio->frame_accept = False;
+    }
+}
+
+/**
+ * Applies one id of an "alive" message.  Objects that are still
+ * alive are stamped with the current generation, anything left
+ * unstamped is removed once the frame is complete.
+ */
+void
+TuioAlive(TuioDevicePtr pTuio, int id)
+{
+    ObjectPtr obj = TuioObjectGet(&pTuio->objects,
+                                  pTuio->source - pTuio->sources, id);
+
+    if (obj != NULL)
+        obj->alive = pTuio->generation;
+}
+
 /**
  * liblo error handler
  */
@@ -601,86 +1971,197 @@ _lo_error(int num,
          const char *msg,
          const char *path)
 {
-    xf86Msg(X_ERROR, "liblo: %s\n", msg);
+    TuioLogMalformed(g_pInfo, "liblo: %s\n", msg);
 }
 
 /**
- * Retrieves an object from a list based on its id.
+ * Creates a liblo server listening on port, with handlers for all
+ * supported messages
  *
- * @return NULL if not found.
+ * @return NULL on error
  */
-static ObjectPtr
-_object_get(ObjectPtr head, int id) {
-    ObjectPtr obj = head;
+static lo_server
+_tuio_lo_server_new(InputInfoPtr pInfo, int port)
+{
+    lo_server server;
+    char *tuio_port;
 
-    while (obj != NULL && obj->id != id) {
-        obj = obj->next;
+    asprintf(&tuio_port, "%i", port);
+    server = lo_server_new_with_proto(tuio_port, LO_UDP, _lo_error);
+    free(tuio_port);
+    if (server == NULL) {
+        xf86Msg(X_ERROR, "%s: Error allocating new lo_server\n",
+                pInfo->name);
+        return NULL;
     }
 
-    return obj;
+    /* Register to receive all /tuio/2Dcur, /tuio/2Dobj and
+     * /tuio/2Dblb messages */
+    lo_server_add_method(server, "/tuio/2Dcur", NULL,
+                         _tuio_lo_2dcur_handle, pInfo);
+    lo_server_add_method(server, "/tuio/2Dobj", NULL,
+                         _tuio_lo_2dobj_handle, pInfo);
+    lo_server_add_method(server, "/tuio/2Dblb", NULL,
+                         _tuio_lo_2dblb_handle, pInfo);
+
+    /* And the TUIO 2.0 frame, pointer, token and alive messages */
+    lo_server_add_method(server, "/tuio2/frm", NULL,
+                         _tuio_lo_frm_handle, pInfo);
+    lo_server_add_method(server, "/tuio2/ptr", NULL,
+                         _tuio_lo_ptr_handle, pInfo);
+    lo_server_add_method(server, "/tuio2/tok", NULL,
+                         _tuio_lo_tok_handle, pInfo);
+    lo_server_add_method(server, "/tuio2/alv", NULL,
+                         _tuio_lo_alv_handle, pInfo);
+
+    return server;
 }
 
 /**
- * Allocates and inserts a new object at the beginning of a list.
- * Pointer to the new object is returned.
- * Doesn't check for duplicate ids, so call _object_get() beforehand
+ * Allocates storage for size objects, and an object table that stays
+ * at most half full when all of them are in use.
+ *
+ * @return False on allocation failure
+ */
+static Bool
+_object_pool_init(TuioDevicePtr pTuio, int size) {
+    unsigned int slots = 1;
+    int i;
+
+    while (slots < (unsigned int)size * 2)
+        slots <<= 1;
+    if (!TuioObjectTableInit(&pTuio->objects, slots))
+        return False;
+
+    pTuio->obj_pool = calloc(size, sizeof(ObjectRec));
+    if (pTuio->obj_pool == NULL)
+        return False;
+
+    pTuio->obj_free = NULL;
+    for (i = size - 1; i >= 0; i--) {
+        pTuio->obj_pool[i].next = pTuio->obj_free;
+        pTuio->obj_free = &pTuio->obj_pool[i];
+    }
+
+    return True;
+}
+
+/**
+ * Takes a new object from the pool.
+ * Doesn't check for duplicate ids, so call TuioObjectGet() beforehand
  * to make sure it doesn't exist already!!
  *
- * @return ptr to newly inserted object
+ * @return ptr to new object, NULL if all objects are in use
  */
 static ObjectPtr 
-_object_new(int id) {
-    ObjectPtr new_obj = malloc(sizeof(ObjectRec));
+_object_new(TuioDevicePtr pTuio, int source, int id) {
+    ObjectPtr new_obj = pTuio->obj_free;
+
+    if (new_obj == NULL)
+        return NULL;
 
+    pTuio->obj_free = new_obj->next;
+    memset(new_obj, 0, sizeof(ObjectRec));
     new_obj->id = id;
-    new_obj->alive = True;
+    new_obj->source = source;
+    new_obj->touch_id = pTuio->next_touch_id++;
 
     return new_obj;
 }
 
 /**
- * Adds a SubDevice to the beginning of the subdev_list list
+ * Removes an object from the table, hands its subdevice on and returns
+ * it to the pool.
+ */
+static void
+_object_release(InputInfoPtr pInfo, ObjectPtr obj) {
+    TuioDevicePtr pTuio = pInfo->private;
+    SubDevicePtr subdev = obj->subdev;
+
+    TuioObjectRemove(&pTuio->objects, obj);
+    TuioWatchdogRemove(obj);
+    pTuio->sources[obj->source].num_objects--;
+    obj->subdev = NULL;
+    _subdev_add(pInfo, subdev);
+
+    obj->next = pTuio->obj_free;
+    pTuio->obj_free = obj;
+}
+
+/**
+ * Ends the touch of an object, and its button press if it has a
+ * subdevice, and releases it.  Objects whose touch hasn't begun are
+ * only released.
  */
 static void
-_object_add(ObjectPtr *obj_list, ObjectPtr obj) {
+_object_end(InputInfoPtr pInfo, ObjectPtr obj) {
+    TuioDevicePtr pTuio = pInfo->private;
 
-    if (obj_list == NULL || obj == NULL)
+    if (obj->pending.button) {
+        _object_release(pInfo, obj);
         return;
+    }
 
-    if (*obj_list != NULL) {
-        obj->next = *obj_list;
+    if (obj->subdev && pTuio->post_button_events) {
+        /* Post button "up" event */
+        if (pTuio->thread != NULL)
+            TuioThreadQueue(pTuio->thread, obj->subdev->pInfo->dev,
+                            ButtonRelease, 0, NULL);
+        else
+            xf86PostButtonEvent(obj->subdev->pInfo->dev, TRUE, 1, FALSE,
+                                0, 0);
     }
-    *obj_list = obj;
+
+    /* The end event carries the latest position, so a deferred update
+     * is no longer needed */
+    if (obj->pending.update)
+        pTuio->coalesced_updates++;
+
+    _tuio_post_touch(pInfo, obj, XI_TouchEnd);
+    TuioCount(pTuio, died, 1);
+    _object_release(pInfo, obj);
 }
 
+/**
+ * Puts all subdevice storage on the free list
+ */
+static void
+_subdev_pool_init(TuioDevicePtr pTuio) {
+    int i;
+
+    pTuio->subdev_free = NULL;
+    for (i = MAX_SUBDEVICES; i >= 0; i--) {
+        pTuio->subdev_pool[i].next = pTuio->subdev_free;
+        pTuio->subdev_free = &pTuio->subdev_pool[i];
+    }
+}
 
 /**
- * Removes an Object with a specific id from a list.
+ * Takes subdevice storage from the pool
+ *
+ * @return NULL if the pool is empty
  */
-static ObjectPtr
-_object_remove(ObjectPtr *obj_list, int id) {
-    ObjectPtr obj = *obj_list;
-    ObjectPtr objtmp;
+static SubDevicePtr
+_subdev_alloc(TuioDevicePtr pTuio) {
+    SubDevicePtr subdev = pTuio->subdev_free;
 
-    if (obj == NULL) return; /* Empty list */
+    if (subdev == NULL)
+        return NULL;
 
-    if (obj->id == id) { /* Remove from head */
-        *obj_list = obj->next;
-    } else {
-        while (obj->next != NULL) {
-            if (obj->next->id == id) {
-                objtmp = obj->next;
-                obj->next = objtmp->next;
-                obj = objtmp;
-                obj->next = NULL;
-                return obj;    
-            }
-            obj = obj->next;
-        }
-        obj = NULL;
-    }
+    pTuio->subdev_free = subdev->next;
+    subdev->next = NULL;
+    subdev->pInfo = NULL;
 
-    return obj;
+    return subdev;
+}
+
+/**
+ * Returns subdevice storage to the pool
+ */
+static void
+_subdev_free(TuioDevicePtr pTuio, SubDevicePtr subdev) {
+    subdev->next = pTuio->subdev_free;
+    pTuio->subdev_free = subdev;
 }
 
 /**
@@ -690,7 +2171,7 @@ static void
 _subdev_add(InputInfoPtr pInfo, SubDevicePtr subdev) {
     TuioDevicePtr pTuio = pInfo->private;
     SubDevicePtr *subdev_list = &pTuio->subdev_list;
-    ObjectPtr obj = pTuio->obj_list;
+    ObjectPtr obj = pTuio->objects.head;
 
     if (subdev_list == NULL || subdev == NULL)
         return;
@@ -700,9 +2181,6 @@ _subdev_add(InputInfoPtr pInfo, SubDevicePtr subdev) {
     while (obj != NULL) {
         if (obj->subdev == NULL) {
             obj->subdev = subdev;
-            if (pTuio->post_button_events)
-                obj->pending.button = True;
-            obj->pending.set = True;
             return;
         }
         obj = obj->next;
@@ -734,20 +2212,37 @@ _subdev_get(InputInfoPtr pInfo, SubDevicePtr *subdev_list) {
     return subdev;
 }
 
+/**
+ * Takes or releases the receive thread's lock, if it runs, since the
+ * thread hands out subdevices to new objects
+ */
+static void
+_subdev_lock(InputInfoPtr pInfo, Bool lock)
+{
+    TuioDevicePtr pTuio = pInfo->private;
+
+    if (pTuio->thread == NULL)
+        return;
+    if (lock)
+        TuioThreadLock(pTuio->thread);
+    else
+        TuioThreadUnlock(pTuio->thread);
+}
+
 static void
 _subdev_remove(InputInfoPtr pInfo, InputInfoPtr sub_pInfo)
 {
     TuioDevicePtr pTuio = pInfo->private;
     SubDevicePtr *subdev_list = &pTuio->subdev_list;
     SubDevicePtr subdev = *subdev_list, last;
-    ObjectPtr obj = pTuio->obj_list;
+    ObjectPtr obj = pTuio->objects.head;
     Bool found = False;
 
     /* First try to find it in the list of subdevices */
     if (subdev != NULL && subdev->pInfo == sub_pInfo) {
         found = True;
         *subdev_list = subdev->next;
-        free(subdev);
+        _subdev_free(pTuio, subdev);
     } else if (subdev != NULL) {
         last = subdev;
         subdev = subdev->next;
@@ -755,7 +2250,7 @@ _subdev_remove(InputInfoPtr pInfo, InputInfoPtr sub_pInfo)
             if (subdev->pInfo == sub_pInfo) {
                 last->next = subdev->next;
                 found = True;
-                free(subdev);
+                _subdev_free(pTuio, subdev);
                 break;
             }
             last = subdev;
@@ -768,7 +2263,7 @@ _subdev_remove(InputInfoPtr pInfo, InputInfoPtr sub_pInfo)
     if (!found) {
         while (obj != NULL) {
             if (obj->subdev != NULL && obj->subdev->pInfo == sub_pInfo) {
-                free(obj->subdev);
+                _subdev_free(pTuio, obj->subdev);
                 obj->subdev = NULL;
                 found = True;
                 break;
@@ -820,12 +2315,21 @@ static int
 _init_axes(DeviceIntPtr device)
 {
     InputInfoPtr        pInfo = device->public.devicePrivate;
+    TuioDevicePtr       pTuio = pInfo->private;
     int                 i;
-    const int           num_axes = 5;
-    Atom *atoms;
-
-    atoms = malloc(num_axes * sizeof(Atom));
-    //atom[0] = XI
+    const int           num_axes = NUM_VALUATORS;
+    Atom atoms[NUM_VALUATORS];
+
+    atoms[0] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_POSITION_X);
+    atoms[1] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_POSITION_Y);
+    atoms[2] = MakeAtom(VAL_X_VELOCITY, strlen(VAL_X_VELOCITY), TRUE);
+    atoms[3] = MakeAtom(VAL_Y_VELOCITY, strlen(VAL_Y_VELOCITY), TRUE);
+    atoms[VAL_ANGLE] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_ORIENTATION);
+    atoms[VAL_WIDTH] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_TOUCH_MAJOR);
+    atoms[VAL_HEIGHT] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_TOUCH_MINOR);
+    atoms[VAL_FIDUCIAL] = MakeAtom(VAL_FIDUCIAL_ID, strlen(VAL_FIDUCIAL_ID),
+                                   TRUE);
+    atoms[VAL_PRESSURE] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_MT_PRESSURE);
 
     if (!InitValuatorClassDeviceStruct(device,
                                        num_axes,
@@ -850,8 +2354,8 @@ _init_axes(DeviceIntPtr device)
         xf86InitValuatorDefaults(device, i);
     }
 
-    /* Setup velocity and acceleration axes */
-    for (i = 2; i < 6; i++)
+    /* Setup velocity axes */
+    for (i = 2; i < NUM_CURSOR_VALUATORS; i++)
     {
         xf86InitValuatorAxisStruct(device, i,
 #if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 7
@@ -861,13 +2365,28 @@ _init_axes(DeviceIntPtr device)
         xf86InitValuatorDefaults(device, i);
     }
 
+    /* Setup the extra axes: angle, width, height, fiducial id and
+     * pressure */
+    for (i = NUM_CURSOR_VALUATORS; i < NUM_VALUATORS; i++)
+    {
+        xf86InitValuatorAxisStruct(device, i,
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 7
+                                   atoms[i],
+#endif
+                                   0, 0x7FFFFFFF, 1, 1, 1,1);
+        xf86InitValuatorDefaults(device, i);
+    }
+
     /* Use absolute mode.  Currently, TUIO coords are mapped to the
      * full screen area */
     //pInfo->dev->valuator->mode = Absolute;
     if (!InitAbsoluteClassDeviceStruct(device))
         return BadAlloc;
 
+    /* Touch events are only delivered by devices with a touch class */
+    if (pTuio && !InitTouchClassDeviceStruct(device, pTuio->max_contacts,
+                                             XIDirectTouch, 2))
+        return BadAlloc;
+
     return Success;
 }
-
-
@@ -28,6 +28,10 @@
 #ifndef TUIO_H 
 #define TUIO_H 
 
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
 #include <X11/extensions/XI.h>
 #include <xf86Xinput.h>
 #include <lo/lo.h>
@@ -47,12 +51,220 @@
 #define DEFAULT_SUBDEVICES 0
 #define DEFAULT_PORT 3333 /* Default UDP port to listen on */
 #define DEFAULT_FSEQ_THRESHOLD 100 /* Default UDP port to listen on */
+#define MIN_CONTACTS 1 /* min/max simultaneous objects */
+#define MAX_CONTACTS 4096
+#define DEFAULT_MAX_CONTACTS 64
+
+/* What to do with a new object when all MaxContacts objects are in use */
+#define OVERFLOW_DROP 0 /* Ignore the new object */
+#define OVERFLOW_EVICT 1 /* End the oldest object and reuse it */
+
+/* How received OSC packets are decoded */
+#define DECODER_LIBLO 0 /* Dispatch through liblo */
+#define DECODER_NATIVE 1 /* Built-in decoder, see osc.c */
+#define OSC_MAX_PACKET 65536 /* Largest datagram that is received */
+
+#define DEFAULT_RECV_BATCH 1 /* Datagrams received per call */
+#define MAX_RECV_BATCH 64
+#define MAX_RECV_BUFFER (64 << 20) /* Largest ReceiveBuffer, in bytes */
+#define DEFAULT_SOCKET_MODE 0660 /* Permissions of SocketPath */
+
+/* Ancillary data is received with each datagram: its kernel receive
+ * time, and the number of datagrams dropped by the socket so far */
+#if defined(SO_TIMESTAMPNS) || defined(SO_RXQ_OVFL)
+#define NET_CONTROL
+#endif
+
+/* Velocities are only derived from positions this close in time */
+#define MAX_VELOCITY_INTERVAL 250000000ULL /* ns */
+
+#define FILTER_DERIVATIVE_CUTOFF 1.0 /* Hz */
+#define DEFAULT_FILTER_BETA 10.0
+
+#define PREDICT_HISTORY 8 /* Positions kept per object for prediction */
+#define MAX_PREDICT_HORIZON 200 /* ms */
+#define DEFAULT_PREDICT_SMOOTHING 0.5
+#define DEFAULT_PREDICT_TREND_SMOOTHING 0.3
+
+/* Objects not confirmed this long after a rebind are ended */
+#define REBIND_TIMEOUT 1000 /* ms */
+
+#define MAX_CONTACT_TIMEOUT 60000 /* ms */
+#define WATCHDOG_SLOTS 16 /* Timer wheel slots, a power of two */
+#define WATCHDOG_RESOLUTION 8 /* Wheel ticks per ContactTimeout */
+
+#define MAX_SOURCES 16 /* Senders tracked at the same time */
+#define SOURCE_NAME_LEN 64
+
+/* TUIO 1.1 profiles and TUIO 2.0 components, used as bit numbers */
+#define PROFILE_2DCUR 0 /* /tuio/2Dcur cursors */
+#define PROFILE_2DOBJ 1 /* /tuio/2Dobj fiducial objects */
+#define PROFILE_2DBLB 2 /* /tuio/2Dblb blobs */
+#define PROFILE_PTR 3 /* /tuio2/ptr pointers */
+#define PROFILE_TOK 4 /* /tuio2/tok tokens */
+#define NUM_TUIO1_PROFILES 3
+#define NUM_PROFILES 5
+/* TUIO 2.0 components share one frame (/tuio2/frm) and alive (/tuio2/alv)
+ * message */
+#define TUIO2_PROFILES (1 << PROFILE_PTR | 1 << PROFILE_TOK)
 
 /* Valuators */
-#define NUM_VALUATORS 4
+#define NUM_VALUATORS 9
+#define NUM_CURSOR_VALUATORS 4 /* x, y, x/y velocity */
+#define VAL_ANGLE 4 /* All but 2Dcur */
+#define VAL_WIDTH 5 /* 2Dblb and ptr, as touch major */
+#define VAL_HEIGHT 6 /* 2Dblb and ptr, as touch minor */
+#define VAL_FIDUCIAL 7 /* 2Dobj and tok class id */
+#define VAL_PRESSURE 8 /* ptr */
 #define VAL_X_VELOCITY "X Velocity"
 #define VAL_Y_VELOCITY "Y Velocity"
 #define VAL_ACCELERATION "Acceleration"
+#define VAL_FIDUCIAL_ID "Fiducial ID"
+
+/**
+ * Subdevices are special devices created at the creation of the first
+ * tuio device (aka "core" device).  They are tuio devices but are only used 
+ * to route object movements through.
+ */
+typedef struct _SubDevice {
+    struct _SubDevice *next;
+
+    InputInfoPtr pInfo;
+} SubDeviceRec, *SubDevicePtr;
+
+/**
+ * A received datagram, pointing into the device's receive ring
+ */
+typedef struct _Packet {
+    unsigned char *data;
+    int len;
+    struct sockaddr_storage addr; /* Sender */
+    socklen_t addrlen;
+    unsigned long long time; /* Receive time, CLOCK_MONOTONIC in ns */
+#ifdef NET_CONTROL
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec)) +
+                 CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control; /* Kernel receive timestamp and drop count */
+#endif
+} PacketRec, *PacketPtr;
+
+/**
+ * A TUIO sender, identified by its address or by the source string of
+ * its TUIO 2.0 frame messages.  Each source has its own session id space
+ * and frame ordering, and can be mapped to a region of the device.
+ */
+typedef struct _Source {
+    Bool used;
+    struct sockaddr_storage addr;
+    socklen_t addrlen; /* 0 for sources named by TUIO 2.0 frames */
+    char name[SOURCE_NAME_LEN];
+    int num_objects;
+    unsigned int generation; /* Last frame received from this source */
+
+    /* Region of the device covered, as origin and scale */
+    float x, y, width, height;
+
+    int fseq_new[NUM_TUIO1_PROFILES], fseq_old[NUM_TUIO1_PROFILES];
+
+    /* TUIO 2.0 frames are ordered by frame id and time instead of fseq */
+    unsigned int frame_id;
+    unsigned long long frame_time; /* OSC timetag of the last frame */
+} SourceRec, *SourcePtr;
+
+/**
+ * A source configured with the SourceN and SourceNRegion options
+ */
+typedef struct _SourceConfig {
+    char *name; /* Host, host:port, or TUIO 2.0 source string */
+    float x, y, width, height;
+} SourceConfigRec;
+
+/**
+ * Homography from TUIO to device coordinates, see calibrate.c
+ */
+typedef struct _Calibration {
+    Bool identity; /* Positions are used as they are */
+    float matrix[9]; /* Row-major, as set */
+    long long coeff[9]; /* Scaled so the last is 1, in 16.16 fixed point */
+} CalibrationRec, *CalibrationPtr;
+
+/* Latency histograms, see stats.c.  Buckets are spaced 4 to a power of
+ * two nanoseconds, up to about 8 s. */
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_BUCKETS 128
+
+typedef struct _Histogram {
+    unsigned long counts[HISTOGRAM_BUCKETS];
+} HistogramRec, *HistogramPtr;
+
+/**
+ * Counters of what happened to received data, exported by property.c.
+ * Only updated on the input path, with TuioCount().
+ */
+typedef struct _Counters {
+    unsigned long packets; /* Datagrams received */
+    unsigned long bundles; /* Datagrams that updated at least one profile */
+    unsigned long stale; /* Frames dropped by the fseq or frame id check */
+    unsigned long malformed; /* Malformed datagrams and messages */
+    unsigned long born; /* Touches begun */
+    unsigned long died; /* Touches ended */
+    unsigned long no_subdev; /* Objects that found no free subdevice */
+    unsigned long overflow; /* Objects dropped or evicted because the
+                               pool was exhausted */
+    unsigned long suppressed; /* Updates within DeadZone, not posted */
+    unsigned long expired; /* Touches ended by ContactTimeout */
+    unsigned long dropped; /* Datagrams the kernel dropped because the
+                              receive buffer was full */
+} CountersRec;
+
+#define TuioCount(pTuio, counter, n) \
+    __atomic_fetch_add(&(pTuio)->counters.counter, (n), __ATOMIC_RELAXED)
+
+/**
+ * Limits the number of messages logged per interval, see TuioLogMalformed()
+ */
+typedef struct _RateLimit {
+    unsigned long long start; /* Start of the current interval */
+    int count; /* Messages in the current interval */
+    unsigned long suppressed;
+} RateLimitRec, *RateLimitPtr;
+
+/**
+ * Timer wheel of the stale contact watchdog, see watchdog.c.  Slot
+ * current comes due at time + tick.
+ */
+typedef struct _Watchdog {
+    struct _Object *slots[WATCHDOG_SLOTS];
+    unsigned int current;
+    unsigned long long time; /* CLOCK_MONOTONIC in ns */
+    unsigned long long tick; /* ns */
+    unsigned long long timeout; /* ns, 0 if not watching */
+} WatchdogRec, *WatchdogPtr;
+
+/* Writer for Option "RecordFile", see record.c */
+typedef struct _Recorder *RecorderPtr;
+
+/* Receive thread for Option "Threaded", see thread.c */
+typedef struct _Thread *ThreadPtr;
+
+/**
+ * Table of live objects.  Objects are found by source and session id
+ * through an open-addressed (linear probing) hash table, and are also
+ * chained in a doubly linked list in order of insertion so that events are always
+ * posted in the same order.  The table is sized to stay at most half
+ * full with MaxContacts objects, so it never needs to grow.  See
+ * object.c.
+ */
+typedef struct _ObjectTable {
+    struct _Object **slots;
+    unsigned int mask; /* Number of slots - 1 */
+    unsigned int shift; /* 32 - log2(number of slots) */
+    unsigned int count;
+
+    struct _Object *head, *tail;
+} ObjectTableRec, *ObjectTablePtr;
 
 /**
  * Tuio device information, including list of current object
@@ -60,17 +272,81 @@
 typedef struct _TuioDevice {
     lo_server server;
 
-    int fseq_new, fseq_old;
-    int processed;
+    SourceRec sources[MAX_SOURCES];
+    SourcePtr source; /* Sender of the current frame */
+    unsigned int next_touch_id; /* Touch ids are shared by all sources */
+
+    Bool frame_accept; /* Current TUIO 2.0 frame is newer than the last */
+    int processed; /* Profiles processed in the current frame */
+    int alive_seen; /* Profiles with an alive message in the current frame */
+    unsigned int generation; /* Incremented for each received frame */
+    unsigned long long timetag; /* OSC timetag of the current frame, 0 or 1
+                                   if it has none */
 
     int num_subdev;
 
-    struct _Object *obj_list;
+    ObjectTableRec objects;
 
     /* List of unused devices that can be allocated for use
      * with ObjectPtr. */
     struct _SubDevice *subdev_list;
 
+    /* Preallocated storage, objects and subdevices are taken from and
+     * returned to these free lists so nothing is allocated while
+     * events are being processed */
+    struct _Object *obj_pool;
+    struct _Object *obj_free;
+    struct _SubDevice *subdev_free;
+
+    /* Scratch space for posting events, allocated in DEVICE_INIT */
+    ValuatorMask *vmask;
+    int valuators[NUM_VALUATORS];
+    Bool vmask_extra; /* vmask holds more than the cursor valuators */
+
+    /* Receive ring, filled by TuioNetReceive() from socket_fd.  Unless
+     * there's a receive thread, socket_fd is also pInfo->fd. */
+    int socket_fd;
+    uint32_t socket_drops; /* Drop count last reported for socket_fd */
+    int socket_dir; /* Directory of SocketPath while bound, or -1 */
+    ino_t socket_ino; /* Of the socket bound at SocketPath */
+    int recv_batch;
+    unsigned char *recv_buf;
+    PacketRec packets[MAX_RECV_BATCH];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr recv_msgs[MAX_RECV_BATCH];
+    struct iovec recv_iov[MAX_RECV_BATCH];
+#endif
+    unsigned long wakeups; /* Calls to TuioProcessInput() */
+    unsigned long recv_calls; /* Receive syscalls, including empty ones */
+    unsigned long coalesced_updates; /* Updates superseded while coalescing */
+    CountersRec counters;
+    RateLimitRec log_limit; /* Errors caused by received data */
+
+    RecorderPtr recorder; /* Set while recording */
+    ThreadPtr thread; /* Set while the receive thread runs */
+
+    /* Objects listed in no frame after generation rebind_generation are
+     * ended once rebind_timer sets rebind_expired, see TuioRebind() */
+    unsigned int rebind_generation;
+    Bool rebind_expired;
+    OsTimerPtr rebind_timer;
+    /* Socket for the next rebind, opened by TuioRebindPrepare(), or -1 */
+    int rebind_fd;
+    lo_server rebind_server;
+    int rebind_port;
+
+    /* Objects not seen for ContactTimeout are ended once watchdog_timer
+     * sets watchdog_due */
+    WatchdogRec watchdog;
+    Bool watchdog_due;
+    OsTimerPtr watchdog_timer;
+
+    /* Time from the wakeup that received a datagram until it was decoded,
+     * and until its events were posted.  Only written on the input path,
+     * and read by property.c. */
+    HistogramRec decode_latency;
+    HistogramRec frame_latency;
+
     /* Remaining variables are set by "Option" values */
     int tuio_port;
     int init_num_subdev;
@@ -79,42 +355,209 @@ typedef struct _TuioDevice {
     int fseq_threshold; /* Maximum difference between consecutive fseq values
                            that will allow a packet to be dropped */
     Bool dynadd_subdev;
+    int max_contacts;
+    int overflow_policy;
+    int decoder;
+    char *socket_path; /* Unix datagram socket to listen on instead of UDP */
+    mode_t socket_mode;
+    gid_t socket_group; /* (gid_t)-1 for the server's group */
+    char *listen_address; /* Numeric address to bind to, NULL for any */
+    char *listen_interface; /* Network interface to receive from */
+    int recv_buffer; /* SO_RCVBUF in bytes, 0 for the kernel default */
+    Bool reuse_port; /* Share the port with other sockets */
+    Bool coalesce; /* Post one update per object per wakeup */
+    Bool threaded; /* Receive and decode in a separate thread */
+    unsigned long long predict_horizon; /* ns, 0 if not predicting */
+    float predict_smoothing; /* Weight of a new position */
+    float predict_trend_smoothing; /* Weight of a new velocity */
+    float filter_min_cutoff; /* Hz, 0 if not filtering */
+    float filter_beta; /* Cutoff increase per unit per second of speed */
+    float dead_zone; /* Smallest movement posted, 0 to post all */
+    CalibrationRec calibration; /* Also set through property.c */
+    char *record_file;
+    int num_source_configs;
+    SourceConfigRec source_configs[MAX_SOURCES];
+
+    /* One subdevice for the core device and each object device */
+    struct _SubDevice subdev_pool[MAX_SUBDEVICES + 1];
 
 } TuioDeviceRec, *TuioDevicePtr;
 
 /**
- * An "Object" can represent a tuio blob or cursor (/tuio/2Dcur or
- * /tuio/2Dblb
+ * Extra state of /tuio/2Dobj and /tuio/2Dblb objects
+ */
+typedef struct _Shape {
+    int class_id; /* 2Dobj fiducial id, tok class id */
+    float angle;
+    float width, height, area; /* 2Dblb, width and height for ptr */
+    float pressure, shear; /* ptr */
+} ShapeRec;
+
+/**
+ * Prediction state of an object, see predict.c
+ */
+typedef struct _Predict {
+    /* Ring of the last positions and their times */
+    unsigned long long time[PREDICT_HISTORY];
+    float xpos[PREDICT_HISTORY], ypos[PREDICT_HISTORY];
+    int head; /* Next slot to be written */
+    int count;
+
+    float level_x, level_y; /* Smoothed position */
+    float trend_x, trend_y; /* Smoothed velocity, in units per second */
+} PredictRec, *PredictPtr;
+
+/**
+ * Jitter filter state of an object, see filter.c
+ */
+typedef struct _Filter {
+    Bool primed; /* Has seen a position */
+    unsigned long long time; /* Of the last position */
+    float x, y; /* Filtered position */
+    float dx, dy; /* Filtered velocity, in units per second */
+} FilterRec, *FilterPtr;
+
+/**
+ * An "Object" can represent a tuio blob, fiducial or cursor (/tuio/2Dblb,
+ * /tuio/2Dobj or /tuio/2Dcur), or a TUIO 2.0 pointer or token (/tuio2/ptr
+ * or /tuio2/tok)
  */
 typedef struct _Object {
-    struct _Object *next;
+    struct _Object *next, *prev;
 
-    int id;
+    int id; /* Session id, unique within its source */
+    int source; /* Index into TuioDeviceRec.sources */
+    unsigned int touch_id; /* Id of the posted touch */
+    int profile;
     float xpos, ypos;
     float xvel, yvel;
-    int alive;
+    ShapeRec shape; /* Not used by 2Dcur */
+    unsigned int alive; /* Generation of the last frame listing this object */
+    unsigned long long time; /* Of the last update in ns, see
+                                _tuio_frame_time() */
+    unsigned long long seen; /* Receive time of the last frame listing
+                                this object */
+    struct _Object *watch_next, **watch_pprev; /* Watchdog slot chain */
+    float post_x, post_y; /* Position to post, filtered and predicted */
+    float posted_x, posted_y; /* Position last posted */
+    FilterRec filter;
+    PredictRec predict;
     struct _SubDevice *subdev;
 
     /* Stores pending information about this object */
     struct {
         Bool alive;
         Bool set;
-        Bool button;
+        Bool button; /* Touch hasn't begun yet */
+        Bool update; /* Update event deferred while coalescing */
         float xpos, ypos;
         float xvel, yvel;
+        ShapeRec shape;
     } pending;
 } ObjectRec, *ObjectPtr;
 
-/**
- * Subdevices are special devices created at the creation of the first
- * tuio device (aka "core" device).  They are tuio devices but are only used 
- * to route object movements through.
- */
-typedef struct _SubDevice {
-    struct _SubDevice *next;
+/* tuio.c */
+void TuioCursorSet(InputInfoPtr pInfo, int id,
+                   float xpos, float ypos, float xvel, float yvel);
+void TuioFiducialSet(InputInfoPtr pInfo, int id, int class_id,
+                     float xpos, float ypos, float angle,
+                     float xvel, float yvel);
+void TuioBlobSet(InputInfoPtr pInfo, int id, float xpos, float ypos,
+                 float angle, float width, float height, float area,
+                 float xvel, float yvel);
+void TuioPointerSet(InputInfoPtr pInfo, int id, float xpos, float ypos,
+                    float angle, float shear, float radius, float pressure,
+                    float xvel, float yvel);
+void TuioTokenSet(InputInfoPtr pInfo, int id, int class_id,
+                  float xpos, float ypos, float angle,
+                  float xvel, float yvel);
+void TuioAlive(TuioDevicePtr pTuio, int id);
+void TuioFrame(TuioDevicePtr pTuio, unsigned int frame_id,
+               unsigned int sec, unsigned int frac, const char *source);
 
-    InputInfoPtr pInfo;
-} SubDeviceRec, *SubDevicePtr;
+void TuioProcessInput(InputInfoPtr pInfo, unsigned long long wakeup);
+int TuioRebindPrepare(InputInfoPtr pInfo, int port);
+int TuioRebind(InputInfoPtr pInfo, int port);
+int TuioLockFrames(InputInfoPtr pInfo);
+void TuioUnlockFrames(InputInfoPtr pInfo, int state);
+void TuioSetContactTimeout(InputInfoPtr pInfo, int timeout);
+
+/* object.c */
+Bool TuioObjectTableInit(ObjectTablePtr table, unsigned int size);
+void TuioObjectTableFree(ObjectTablePtr table);
+ObjectPtr TuioObjectGet(ObjectTablePtr table, int source, int id);
+void TuioObjectAdd(ObjectTablePtr table, ObjectPtr obj);
+ObjectPtr TuioObjectRemove(ObjectTablePtr table, ObjectPtr obj);
+
+/* osc.c */
+int TuioOscDecode(InputInfoPtr pInfo, const unsigned char *buf, int len);
+
+/* source.c */
+void TuioSourceInit(InputInfoPtr pInfo);
+SourcePtr TuioSourceFromAddress(TuioDevicePtr pTuio,
+                                const struct sockaddr_storage *addr,
+                                socklen_t addrlen);
+SourcePtr TuioSourceFromName(TuioDevicePtr pTuio, const char *name);
+
+/* record.c */
+RecorderPtr TuioRecordOpen(InputInfoPtr pInfo, const char *path);
+void TuioRecordClose(InputInfoPtr pInfo, RecorderPtr rec);
+void TuioRecordPackets(RecorderPtr rec, PacketPtr packets, int n);
+
+/* stats.c */
+unsigned long long TuioTime(void);
+void TuioHistogramAdd(HistogramPtr hist, unsigned long long ns);
+unsigned long long TuioHistogramPercentile(HistogramPtr hist, double p,
+                                           unsigned long *total);
+void TuioLogInput(InputInfoPtr pInfo, MessageType type,
+                  const char *format, ...);
+void TuioLogMalformed(InputInfoPtr pInfo, const char *format, ...);
+
+/* property.c */
+void TuioPropertyInit(DeviceIntPtr device);
+
+/* calibrate.c */
+Bool TuioCalibrationSet(CalibrationPtr cal, const float *matrix);
+void TuioCalibrationInit(InputInfoPtr pInfo);
+void TuioCalibrate(CalibrationPtr cal, float x, float y, int *valuators);
+
+/* filter.c */
+void TuioFilterUpdate(TuioDevicePtr pTuio, ObjectPtr obj);
+
+/* predict.c */
+void TuioPredictUpdate(TuioDevicePtr pTuio, ObjectPtr obj);
+
+/* watchdog.c */
+void TuioWatchdogSetTimeout(TuioDevicePtr pTuio, unsigned long long timeout);
+void TuioWatchdogAdd(TuioDevicePtr pTuio, ObjectPtr obj);
+void TuioWatchdogRemove(ObjectPtr obj);
+ObjectPtr TuioWatchdogExpire(TuioDevicePtr pTuio, unsigned long long now);
+
+/* thread.c */
+ThreadPtr TuioThreadStart(InputInfoPtr pInfo);
+void TuioThreadStop(InputInfoPtr pInfo, ThreadPtr thread);
+void TuioThreadLock(ThreadPtr thread);
+void TuioThreadUnlock(ThreadPtr thread);
+void TuioThreadHold(ThreadPtr thread);
+void TuioThreadResume(ThreadPtr thread);
+void TuioThreadWake(ThreadPtr thread);
+Bool TuioThreadRoom(ThreadPtr thread);
+void TuioThreadLog(ThreadPtr thread, MessageType type,
+                   const char *format, ...);
+void TuioThreadQueue(ThreadPtr thread, DeviceIntPtr dev, int type,
+                     unsigned int touch_id, const ValuatorMask *vmask);
+void TuioThreadFrameDone(ThreadPtr thread);
+void TuioThreadPost(InputInfoPtr pInfo, ThreadPtr thread);
+
+/* net.c */
+Bool TuioNetInit(TuioDevicePtr pTuio);
+int TuioNetOpen(InputInfoPtr pInfo, int port);
+int TuioNetPublish(InputInfoPtr pInfo);
+void TuioNetDiscard(InputInfoPtr pInfo, int fd);
+void TuioNetClose(InputInfoPtr pInfo, int fd);
+void TuioNetUnixInit(InputInfoPtr pInfo);
+int TuioNetReceive(InputInfoPtr pInfo);
+void TuioNetSetup(InputInfoPtr pInfo, int fd);
 
 #endif
 
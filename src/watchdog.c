@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Stale contact watchdog (Option "ContactTimeout").  Objects normally end
+ * when an alive message leaves them out, which never happens if the
+ * tracker dies or the last alive message is lost.  The watchdog ends
+ * objects that no frame has listed for ContactTimeout.
+ *
+ * Objects are kept in a timer wheel, each in the slot of the tick at
+ * which it is next checked.  A frame only updates an object's last-seen
+ * time; the wheel is left alone until the slot comes up, and an object
+ * that turns out to have been seen since is moved on to its new deadline.
+ * The timer therefore only looks at the objects of the slots that have
+ * come due.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+/**
+ * Sets the timeout in ns, 0 to stop watching, and puts the objects in
+ * the table into the wheel afresh
+ */
+void
+TuioWatchdogSetTimeout(TuioDevicePtr pTuio, unsigned long long timeout)
+{
+    WatchdogPtr wd = &pTuio->watchdog;
+    unsigned long long now = TuioTime();
+    ObjectPtr obj;
+    int i;
+
+    for (i = 0; i < WATCHDOG_SLOTS; i++)
+        wd->slots[i] = NULL;
+    for (obj = pTuio->objects.head; obj != NULL; obj = obj->next)
+        obj->watch_pprev = NULL;
+
+    wd->timeout = timeout;
+    if (timeout == 0)
+        return;
+
+    wd->tick = timeout / WATCHDOG_RESOLUTION;
+    if (wd->tick < 1000000)
+        wd->tick = 1000000;
+    wd->current = 0;
+    wd->time = now;
+    for (obj = pTuio->objects.head; obj != NULL; obj = obj->next)
+        TuioWatchdogAdd(pTuio, obj);
+}
+
+/**
+ * Puts an object into the slot of its deadline, or the last slot if that
+ * is further away than the wheel reaches
+ */
+void
+TuioWatchdogAdd(TuioDevicePtr pTuio, ObjectPtr obj)
+{
+    WatchdogPtr wd = &pTuio->watchdog;
+    unsigned long long deadline = obj->seen + wd->timeout;
+    unsigned long long ticks = 0;
+    ObjectPtr *slot;
+
+    if (wd->timeout == 0)
+        return;
+
+    if (deadline > wd->time)
+        ticks = (deadline - wd->time + wd->tick - 1) / wd->tick;
+    if (ticks >= WATCHDOG_SLOTS)
+        ticks = WATCHDOG_SLOTS - 1;
+
+    slot = &wd->slots[(wd->current + ticks) & (WATCHDOG_SLOTS - 1)];
+    obj->watch_next = *slot;
+    if (*slot != NULL)
+        (*slot)->watch_pprev = &obj->watch_next;
+    obj->watch_pprev = slot;
+    *slot = obj;
+}
+
+/**
+ * Takes an object out of the wheel, if it is in it
+ */
+void
+TuioWatchdogRemove(ObjectPtr obj)
+{
+    if (obj->watch_pprev == NULL)
+        return;
+
+    *obj->watch_pprev = obj->watch_next;
+    if (obj->watch_next != NULL)
+        obj->watch_next->watch_pprev = obj->watch_pprev;
+    obj->watch_pprev = NULL;
+}
+
+/**
+ * Advances the wheel to now.  Objects in the slots that came due are
+ * moved on if they have been seen since they were put there.
+ *
+ * @return the objects not seen for the timeout, taken out of the wheel
+ * and chained through watch_next
+ */
+ObjectPtr
+TuioWatchdogExpire(TuioDevicePtr pTuio, unsigned long long now)
+{
+    WatchdogPtr wd = &pTuio->watchdog;
+    ObjectPtr expired = NULL, obj, next;
+    unsigned long long ticks, i;
+
+    if (wd->timeout == 0 || now < wd->time + wd->tick)
+        return NULL;
+
+    ticks = (now - wd->time) / wd->tick;
+    if (ticks > WATCHDOG_SLOTS) {
+        /* After a long delay every slot is due, but only once */
+        wd->time += (ticks - WATCHDOG_SLOTS) * wd->tick;
+        ticks = WATCHDOG_SLOTS;
+    }
+
+    for (i = 0; i < ticks; i++) {
+        obj = wd->slots[wd->current];
+        wd->slots[wd->current] = NULL;
+        wd->current = (wd->current + 1) & (WATCHDOG_SLOTS - 1);
+        wd->time += wd->tick;
+
+        for (; obj != NULL; obj = next) {
+            next = obj->watch_next;
+            obj->watch_pprev = NULL;
+            if (now - obj->seen >= wd->timeout) {
+                obj->watch_next = expired;
+                expired = obj;
+            } else {
+                TuioWatchdogAdd(pTuio, obj);
+            }
+        }
+    }
+
+    return expired;
+}
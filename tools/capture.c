@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Capture loading.  Captures are either logs written by the driver's
+ * RecordFile option (see src/record.c), or pcap files, as written by
+ * tcpdump or wireshark, of UDP traffic over Ethernet, Linux cooked (any),
+ * raw IP or loopback links.  Only the UDP payloads are kept.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define RECORD_MAGIC "TUIOREC1"
+#define RECORD_HEADER_SIZE 32
+
+#define PCAP_MAGIC 0xa1b2c3d4 /* Microsecond timestamps */
+#define PCAP_MAGIC_NSEC 0xa1b23c4d /* Nanosecond timestamps */
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_SIZE 16
+
+/* Link types */
+#define LINK_NULL 0
+#define LINK_ETHERNET 1
+#define LINK_RAW 101
+#define LINK_LOOP 108
+#define LINK_LINUX_SLL 113
+#define LINK_LINUX_SLL2 276
+
+#define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_IPV6 0x86dd
+#define IPPROTO_UDP_NUM 17
+
+static uint32_t
+_read32(const unsigned char *p, int swap)
+{
+    if (swap)
+        return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    return (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static unsigned int
+_read16be(const unsigned char *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+/**
+ * Finds the UDP payload of a link layer frame
+ *
+ * @return the payload length, -1 if the frame isn't a UDP datagram to port
+ * (or to any port if port is 0).  The sender's address, port and family
+ * are stored in sender.
+ */
+static int
+_udp_payload(const unsigned char *frame, int len, int linktype, int port,
+             const unsigned char **payload, unsigned char *sender)
+{
+    const unsigned char *ip;
+    unsigned int ethertype, family;
+    int hlen, udp_len;
+
+    switch (linktype) {
+        case LINK_ETHERNET:
+            if (len < 14)
+                return -1;
+            ethertype = _read16be(frame + 12);
+            hlen = 14;
+            if (ethertype == ETHERTYPE_VLAN) {
+                if (len < 18)
+                    return -1;
+                ethertype = _read16be(frame + 16);
+                hlen = 18;
+            }
+            break;
+        case LINK_LINUX_SLL:
+            if (len < 16)
+                return -1;
+            ethertype = _read16be(frame + 14);
+            hlen = 16;
+            break;
+        case LINK_LINUX_SLL2:
+            if (len < 20)
+                return -1;
+            ethertype = _read16be(frame);
+            hlen = 20;
+            break;
+        case LINK_NULL:
+        case LINK_LOOP:
+            /* Address family, in either byte order */
+            if (len < 4)
+                return -1;
+            family = frame[0] | frame[3];
+            ethertype = family == 2 ? ETHERTYPE_IP : ETHERTYPE_IPV6;
+            hlen = 4;
+            break;
+        case LINK_RAW:
+            if (len < 1)
+                return -1;
+            ethertype = (frame[0] >> 4) == 4 ? ETHERTYPE_IP : ETHERTYPE_IPV6;
+            hlen = 0;
+            break;
+        default:
+            return -1;
+    }
+
+    ip = frame + hlen;
+    len -= hlen;
+
+    if (ethertype == ETHERTYPE_IP) {
+        if (len < 20 || ip[9] != IPPROTO_UDP_NUM)
+            return -1;
+        /* Only the first fragment carries the UDP header */
+        if ((_read16be(ip + 6) & 0x3fff) != 0)
+            return -1;
+        hlen = (ip[0] & 0x0f) * 4;
+        memset(sender, 0, 16);
+        memcpy(sender, ip + 12, 4);
+        sender[18] = 4;
+    } else if (ethertype == ETHERTYPE_IPV6) {
+        /* Extension headers are not followed */
+        if (len < 40 || ip[6] != IPPROTO_UDP_NUM)
+            return -1;
+        hlen = 40;
+        memcpy(sender, ip + 8, 16);
+        sender[18] = 6;
+    } else {
+        return -1;
+    }
+
+    if (len < hlen + 8)
+        return -1;
+    if (port != 0 && _read16be(ip + hlen + 2) != (unsigned int)port)
+        return -1;
+
+    udp_len = _read16be(ip + hlen + 4) - 8;
+    if (udp_len < 0 || udp_len > len - hlen - 8)
+        return -1;
+
+    memcpy(sender + 16, ip + hlen, 2);
+    *payload = ip + hlen + 8;
+    return udp_len;
+}
+
+/**
+ * Finds the index of a sender, adding it if it is new
+ */
+static int
+_sender_index(CapturePtr cap, const unsigned char *sender)
+{
+    int i;
+
+    for (i = 0; i < cap->num_senders; i++) {
+        if (memcmp(cap->senders[i], sender, sizeof(cap->senders[i])) == 0)
+            return i;
+    }
+    if (cap->num_senders == CAPTURE_MAX_SENDERS)
+        return CAPTURE_MAX_SENDERS - 1;
+
+    memcpy(cap->senders[i], sender, sizeof(cap->senders[i]));
+    if (sender[18] == CAPTURE_FAMILY_UNIX)
+        cap->num_unix_senders++;
+    return cap->num_senders++;
+}
+
+/**
+ * Loads the datagrams of a RecordFile log.  The port of the driver
+ * isn't recorded, so all of them are loaded.  Senders on a Unix socket
+ * are told apart by the start of their name.
+ */
+static void
+_load_record(CapturePtr cap, long size)
+{
+    const unsigned char *rec = cap->buf + 8;
+    unsigned char sender[CAPTURE_SENDER_SIZE];
+    uint64_t time, first = 0;
+    uint32_t len;
+
+    while (rec + RECORD_HEADER_SIZE <= cap->buf + size) {
+        len = _read32(rec, 1);
+        if (len > cap->buf + size - rec - RECORD_HEADER_SIZE)
+            break;
+
+        time = (uint64_t)_read32(rec + 8, 1) << 32 | _read32(rec + 12, 1);
+        if (cap->num_packets == 0)
+            first = time;
+
+        memcpy(sender, rec + 16, 16);
+        memcpy(sender + 16, rec + 4, 2);
+        sender[18] = _read16be(rec + 6); /* 1 is CAPTURE_FAMILY_UNIX */
+
+        cap->packets[cap->num_packets].data = rec + RECORD_HEADER_SIZE;
+        cap->packets[cap->num_packets].len = len;
+        cap->packets[cap->num_packets].time = time - first;
+        cap->packets[cap->num_packets].sender = _sender_index(cap, sender);
+        cap->num_packets++;
+
+        rec += RECORD_HEADER_SIZE + len;
+    }
+}
+
+/**
+ * Loads the UDP datagrams sent to port (any port if 0) from a pcap file
+ *
+ * @return 0 on success, -1 on error
+ */
+int
+CaptureLoad(CapturePtr cap, const char *path, int port)
+{
+    const unsigned char *rec, *payload;
+    unsigned char sender[CAPTURE_SENDER_SIZE];
+    uint32_t magic;
+    uint64_t time, first = 0;
+    long size;
+    int swap, nsec, linktype, caplen, len, max;
+    FILE *f;
+
+    memset(cap, 0, sizeof(CaptureRec));
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    cap->buf = malloc(size > 0 ? size : 1);
+    if (cap->buf == NULL || fread(cap->buf, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: Failed to read capture\n", path);
+        fclose(f);
+        CaptureFree(cap);
+        return -1;
+    }
+    fclose(f);
+
+    /* Every record needs at least its header, which bounds the count */
+    max = size / PCAP_RECORD_SIZE;
+    cap->packets = malloc((max > 0 ? max : 1) * sizeof(CapturePacketRec));
+    if (cap->packets == NULL) {
+        CaptureFree(cap);
+        return -1;
+    }
+
+    if (size >= 8 && memcmp(cap->buf, RECORD_MAGIC, 8) == 0) {
+        _load_record(cap, size);
+        return 0;
+    }
+
+    if (size < PCAP_HEADER_SIZE)
+        goto bad_file;
+
+    magic = _read32(cap->buf, 0);
+    swap = 0;
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC) {
+        swap = 1;
+        magic = _read32(cap->buf, 1);
+        if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC)
+            goto bad_file;
+    }
+    nsec = magic == PCAP_MAGIC_NSEC;
+    linktype = _read32(cap->buf + 20, swap) & 0xffff;
+
+    rec = cap->buf + PCAP_HEADER_SIZE;
+    while (rec + PCAP_RECORD_SIZE <= cap->buf + size) {
+        caplen = _read32(rec + 8, swap);
+        if (caplen < 0 || caplen > cap->buf + size - rec - PCAP_RECORD_SIZE)
+            break;
+
+        time = (uint64_t)_read32(rec, swap) * 1000000000 +
+               (uint64_t)_read32(rec + 4, swap) * (nsec ? 1 : 1000);
+
+        len = _udp_payload(rec + PCAP_RECORD_SIZE, caplen, linktype, port,
+                           &payload, sender);
+        if (len >= 0) {
+            if (cap->num_packets == 0)
+                first = time;
+            cap->packets[cap->num_packets].data = payload;
+            cap->packets[cap->num_packets].len = len;
+            cap->packets[cap->num_packets].time = time - first;
+            cap->packets[cap->num_packets].sender = _sender_index(cap, sender);
+            cap->num_packets++;
+        }
+
+        rec += PCAP_RECORD_SIZE + caplen;
+    }
+
+    return 0;
+
+bad_file:
+    fprintf(stderr, "%s: Not a pcap file or RecordFile log\n", path);
+    CaptureFree(cap);
+    return -1;
+}
+
+/**
+ * Frees a loaded capture
+ */
+void
+CaptureFree(CapturePtr cap)
+{
+    free(cap->packets);
+    free(cap->buf);
+    memset(cap, 0, sizeof(CaptureRec));
+}
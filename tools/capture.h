@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Reading of recorded TUIO traffic for the tools
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+/**
+ * A recorded datagram.  data points into the capture's storage.
+ */
+typedef struct _CapturePacket {
+    const unsigned char *data;
+    int len;
+    uint64_t time; /* Receive time in ns, relative to the first packet */
+    int sender; /* Index of the sender's address and port */
+} CapturePacketRec, *CapturePacketPtr;
+
+#define CAPTURE_MAX_SENDERS 16
+#define CAPTURE_SENDER_SIZE 19 /* Address, port and family */
+#define CAPTURE_FAMILY_UNIX 1 /* Family of senders on a Unix socket */
+
+/**
+ * All UDP payloads of a capture, loaded into memory.  Senders beyond
+ * CAPTURE_MAX_SENDERS share the last index.
+ */
+typedef struct _Capture {
+    unsigned char *buf;
+    CapturePacketPtr packets;
+    int num_packets;
+    unsigned char senders[CAPTURE_MAX_SENDERS][CAPTURE_SENDER_SIZE];
+    int num_senders;
+    int num_unix_senders;
+} CaptureRec, *CapturePtr;
+
+int CaptureLoad(CapturePtr cap, const char *path, int port);
+void CaptureFree(CapturePtr cap);
+
+#endif
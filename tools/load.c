@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * tuio-load: sends synthetic /tuio/2Dcur traffic to the driver.  Contacts
+ * move in circles, are born and die at random, and frames can be
+ * reordered or duplicated on the way.  Each sender uses its own socket,
+ * session ids and frame sequence, as separate trackers would.
+ *
+ * Usage: tuio-load [-h host] [-p port] [-c contacts] [-r rate] [-t seconds]
+ *                  [-s senders] [-l lifetime] [-o reorder] [-d duplicate]
+ *                  [-b burst]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#define MAX_SENDERS 16
+#define MAX_CONTACTS 1024 /* Largest frame that fits in one datagram */
+#define MAX_BUNDLE 65536
+
+typedef struct _Contact {
+    int id;
+    float phase, radius, speed;
+    float x, y, xvel, yvel;
+} ContactRec, *ContactPtr;
+
+typedef struct _Sender {
+    int fd;
+    int fseq;
+    int next_id;
+    ContactRec contacts[MAX_CONTACTS];
+
+    /* Frame held back to be sent after the next one */
+    unsigned char held[MAX_BUNDLE];
+    int held_len;
+} SenderRec, *SenderPtr;
+
+typedef struct _Bundle {
+    unsigned char data[MAX_BUNDLE];
+    int len;
+} BundleRec, *BundlePtr;
+
+static int num_contacts = 10;
+static double lifetime = 0; /* Mean contact lifetime in frames, 0 forever */
+static double reorder = 0; /* Probability of swapping a frame with the next */
+static double duplicate = 0; /* Probability of sending a frame twice */
+
+static unsigned long frames_sent, datagrams_sent, births, deaths;
+
+static uint64_t
+_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double
+_random(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+/* OSC encoding */
+
+static void
+_put_word(BundlePtr b, uint32_t word)
+{
+    word = htonl(word);
+    memcpy(b->data + b->len, &word, 4);
+    b->len += 4;
+}
+
+static void
+_put_float(BundlePtr b, float f)
+{
+    uint32_t word;
+
+    memcpy(&word, &f, 4);
+    _put_word(b, word);
+}
+
+static void
+_put_string(BundlePtr b, const char *s)
+{
+    int size = strlen(s) + 1;
+
+    memcpy(b->data + b->len, s, size);
+    b->len += size;
+    while (b->len & 3)
+        b->data[b->len++] = '\0';
+}
+
+/**
+ * Starts a message, the size is filled in by _end_message()
+ */
+static int
+_begin_message(BundlePtr b, const char *command, const char *types)
+{
+    int start = b->len;
+
+    _put_word(b, 0);
+    _put_string(b, "/tuio/2Dcur");
+    _put_string(b, types);
+    _put_string(b, command);
+    return start;
+}
+
+static void
+_end_message(BundlePtr b, int start)
+{
+    uint32_t size = htonl(b->len - start - 4);
+
+    memcpy(b->data + start, &size, 4);
+}
+
+/**
+ * Encodes one frame of a sender as an alive/set/fseq bundle
+ */
+static void
+_encode_frame(SenderPtr sender, BundlePtr b)
+{
+    char types[MAX_CONTACTS + 3];
+    int i, start;
+
+    b->len = 0;
+    _put_string(b, "#bundle");
+    _put_word(b, 0); /* Immediate timetag */
+    _put_word(b, 1);
+
+    types[0] = ',';
+    types[1] = 's';
+    for (i = 0; i < num_contacts; i++)
+        types[i + 2] = 'i';
+    types[i + 2] = '\0';
+    start = _begin_message(b, "alive", types);
+    for (i = 0; i < num_contacts; i++)
+        _put_word(b, sender->contacts[i].id);
+    _end_message(b, start);
+
+    for (i = 0; i < num_contacts; i++) {
+        ContactPtr c = &sender->contacts[i];
+
+        start = _begin_message(b, "set", ",sifffff");
+        _put_word(b, c->id);
+        _put_float(b, c->x);
+        _put_float(b, c->y);
+        _put_float(b, c->xvel);
+        _put_float(b, c->yvel);
+        _put_float(b, 0);
+        _end_message(b, start);
+    }
+
+    start = _begin_message(b, "fseq", ",si");
+    _put_word(b, ++sender->fseq);
+    _end_message(b, start);
+}
+
+/* Contacts */
+
+static void
+_contact_new(SenderPtr sender, ContactPtr c)
+{
+    c->id = sender->next_id++;
+    c->phase = _random() * 2 * M_PI;
+    c->radius = 0.05 + _random() * 0.4;
+    c->speed = (_random() - 0.5) * 2 * M_PI; /* Radians per second */
+    births++;
+}
+
+/**
+ * Moves every contact to time t, replacing those that die
+ */
+static void
+_advance(SenderPtr sender, double t, double rate)
+{
+    int i;
+
+    for (i = 0; i < num_contacts; i++) {
+        ContactPtr c = &sender->contacts[i];
+        float a, x, y;
+
+        if (lifetime > 0 && _random() < 1 / lifetime) {
+            deaths++;
+            _contact_new(sender, c);
+        }
+
+        a = c->phase + c->speed * t;
+        x = 0.5 + c->radius * cos(a);
+        y = 0.5 + c->radius * sin(a);
+        c->xvel = (x - c->x) * rate;
+        c->yvel = (y - c->y) * rate;
+        c->x = x;
+        c->y = y;
+    }
+}
+
+static void
+_send(SenderPtr sender, const unsigned char *data, int len)
+{
+    if (send(sender->fd, data, len, 0) == len)
+        datagrams_sent++;
+}
+
+/**
+ * Sends a frame, holding it back or repeating it as configured
+ */
+static void
+_send_frame(SenderPtr sender, BundlePtr b)
+{
+    frames_sent++;
+
+    if (sender->held_len == 0 && _random() < reorder) {
+        memcpy(sender->held, b->data, b->len);
+        sender->held_len = b->len;
+        return;
+    }
+
+    _send(sender, b->data, b->len);
+    if (_random() < duplicate)
+        _send(sender, b->data, b->len);
+
+    if (sender->held_len > 0) {
+        _send(sender, sender->held, sender->held_len);
+        sender->held_len = 0;
+    }
+}
+
+static int
+_connect(const char *host, const char *port)
+{
+    struct addrinfo hints, *res;
+    int fd, err;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        perror("socket");
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+static void
+_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h host       Host to send to (default localhost)\n"
+            "  -p port       Port to send to (default 3333)\n"
+            "  -c contacts   Contacts per sender (default 10)\n"
+            "  -r rate       Frames per second per sender (default 60)\n"
+            "  -t seconds    Time to run for (default 10)\n"
+            "  -s senders    Number of senders (default 1)\n"
+            "  -l lifetime   Mean contact lifetime in frames (default: "
+            "contacts never die)\n"
+            "  -o reorder    Probability of a frame arriving after the next\n"
+            "  -d duplicate  Probability of a frame arriving twice\n"
+            "  -b burst      Frames sent back to back at each tick "
+            "(default 1)\n",
+            name);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    static SenderRec senders[MAX_SENDERS];
+    static BundleRec bundle;
+    const char *host = "localhost", *port = "3333";
+    double rate = 60, seconds = 10, t;
+    uint64_t start, next, period;
+    int num_senders = 1, burst = 1;
+    int opt, i, j, k;
+
+    while ((opt = getopt(argc, argv, "h:p:c:r:t:s:l:o:d:b:")) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = optarg; break;
+            case 'c': num_contacts = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 't': seconds = atof(optarg); break;
+            case 's': num_senders = atoi(optarg); break;
+            case 'l': lifetime = atof(optarg); break;
+            case 'o': reorder = atof(optarg); break;
+            case 'd': duplicate = atof(optarg); break;
+            case 'b': burst = atoi(optarg); break;
+            default: _usage(argv[0]);
+        }
+    }
+    if (optind != argc || num_contacts < 0 || num_contacts > MAX_CONTACTS ||
+        num_senders < 1 || num_senders > MAX_SENDERS || rate <= 0 ||
+        burst < 1)
+        _usage(argv[0]);
+
+    srand(time(NULL));
+    for (i = 0; i < num_senders; i++) {
+        senders[i].fd = _connect(host, port);
+        if (senders[i].fd < 0)
+            return 1;
+        senders[i].next_id = 1;
+        for (j = 0; j < num_contacts; j++)
+            _contact_new(&senders[i], &senders[i].contacts[j]);
+    }
+
+    /* A tick sends burst frames from every sender */
+    period = 1e9 * burst / rate;
+    start = next = _now();
+    while (next - start < seconds * 1e9) {
+        while (_now() < next)
+            usleep(100);
+
+        for (k = 0; k < burst; k++) {
+            t = (double)(next - start) / 1e9 + k / rate;
+            for (i = 0; i < num_senders; i++) {
+                _advance(&senders[i], t, rate);
+                _encode_frame(&senders[i], &bundle);
+                _send_frame(&senders[i], &bundle);
+            }
+        }
+        next += period;
+    }
+
+    printf("%lu frames in %lu datagrams, %lu births, %lu deaths, "
+           "%.1f s\n", frames_sent, datagrams_sent, births, deaths,
+           (_now() - start) / 1e9);
+
+    return 0;
+}
@@ -0,0 +1,566 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * tuio-replay: runs the driver outside of the X server and feeds it a
+ * recorded capture (pcap or RecordFile log) over local UDP sockets, one
+ * per sender in the capture, then reports how fast the datagrams were
+ * processed.  With Option "SocketPath", the datagrams are sent to that
+ * Unix socket instead, so replaying the same capture with and without it
+ * compares the transports: the transport latency is the time from sending
+ * until the driver's descriptor is readable.  Senders of a RecordFile log
+ * that were on a Unix socket are kept apart either way.  With Option
+ * "PredictHorizon", it also reports how far the posted touches were from
+ * where the touches actually were a horizon later; replay at the original
+ * rate (-r) for this to be meaningful.
+ *
+ * With -a, the first pass through the capture warms the driver up, and
+ * replay fails if it allocates memory on any wakeup after that.  With -c,
+ * the capture is replayed to a device with Decoder "liblo" and then to
+ * one with Decoder "native".  The driver's time per datagram is
+ * compared, and replay fails if the decoders posted different numbers of
+ * events or disagree on any counter that doesn't depend on timing.
+ *
+ * Usage: tuio-replay [-o Option=Value]... [-b batch] [-n repeat] [-p port]
+ *                    [-r] [-a] [-c] capture
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+#include "capture.h"
+#include "stubs.h"
+
+extern InputDriverRec TUIO;
+
+static int batch = 1; /* Datagrams sent per wakeup */
+static int repeat = 1; /* Passes through the capture */
+static int realtime = 0; /* Keep the capture's original spacing */
+static int check_allocs = 0; /* Fail if the driver allocates after a pass */
+
+static uint64_t
+_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int
+_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int
+_compare_touch(const void *a, const void *b)
+{
+    const StubTouchRec *x = a, *y = b;
+
+    if (x->touch_id != y->touch_id)
+        return x->touch_id < y->touch_id ? -1 : 1;
+    return x->time < y->time ? -1 : x->time > y->time;
+}
+
+/**
+ * Stamps the positions posted since the last wakeup with the current
+ * time, and adds the actual positions of all begun touches to actual
+ */
+static void
+_trace_wakeup(TuioDevicePtr pTuio, StubTracePtr posted, unsigned long *done,
+              StubTracePtr actual, uint64_t time)
+{
+    ObjectPtr obj;
+
+    for (; *done < posted->num_touches; (*done)++)
+        posted->touches[*done].time = time;
+
+    for (obj = pTuio->objects.head; obj != NULL; obj = obj->next) {
+        if (!obj->pending.button)
+            StubTraceAdd(actual, obj->touch_id, obj->xpos, obj->ypos, time);
+    }
+}
+
+/**
+ * Finds the actual position of a touch at time, interpolating between
+ * the positions around it.  actual must be sorted by _compare_touch().
+ *
+ * @return 0 if the touch wasn't seen both before and after time
+ */
+static int
+_trace_position(StubTracePtr actual, unsigned int touch_id, uint64_t time,
+                double *x, double *y)
+{
+    unsigned long lo = 0, hi = actual->num_touches, mid;
+    StubTouchRec key = { touch_id, 0, 0, time };
+    StubTouchPtr a, b;
+    double f;
+
+    /* First position at or after time */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (_compare_touch(&actual->touches[mid], &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 || lo == actual->num_touches)
+        return 0;
+
+    b = &actual->touches[lo];
+    a = &actual->touches[lo - 1];
+    if (a->touch_id != touch_id || b->touch_id != touch_id)
+        return 0;
+
+    f = (double)(time - a->time) / (b->time - a->time);
+    *x = a->x + (b->x - a->x) * f;
+    *y = a->y + (b->y - a->y) * f;
+    return 1;
+}
+
+/**
+ * Prints the mean and 95th percentile distance of the posted positions
+ * from the actual positions a horizon later, and the same for the actual
+ * positions at the time, i.e. without prediction
+ */
+static void
+_report_prediction(StubTracePtr posted, StubTracePtr actual,
+                   uint64_t horizon)
+{
+    double *error, *lag, x, y, ax, ay, error_sum = 0, lag_sum = 0;
+    unsigned long i, n = 0;
+
+    error = malloc(posted->num_touches * sizeof(double));
+    lag = malloc(posted->num_touches * sizeof(double));
+    if (error == NULL || lag == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    qsort(actual->touches, actual->num_touches, sizeof(StubTouchRec),
+          _compare_touch);
+    for (i = 0; i < posted->num_touches; i++) {
+        StubTouchPtr p = &posted->touches[i];
+
+        if (!_trace_position(actual, p->touch_id, p->time + horizon, &x, &y) ||
+            !_trace_position(actual, p->touch_id, p->time, &ax, &ay))
+            continue;
+        error[n] = hypot(p->x - x, p->y - y);
+        lag[n] = hypot(ax - x, ay - y);
+        error_sum += error[n];
+        lag_sum += lag[n++];
+    }
+
+    if (n > 0) {
+        qsort(error, n, sizeof(double), _compare_double);
+        qsort(lag, n, sizeof(double), _compare_double);
+        printf("prediction error %.0f ms ahead, in fractions of the device: "
+               "mean %.4f, p95 %.4f; without prediction: mean %.4f, "
+               "p95 %.4f\n", horizon / 1e6, error_sum / n, error[n * 95 / 100],
+               lag_sum / n, lag[n * 95 / 100]);
+    }
+    free(error);
+    free(lag);
+}
+
+static void
+_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] capture\n"
+            "  -o Option=Value  Set a driver option, may be repeated\n"
+            "  -b batch         Datagrams sent per wakeup (default 1)\n"
+            "  -n repeat        Times to replay the capture (default 1)\n"
+            "  -p port          Only replay datagrams sent to port\n"
+            "  -r               Replay at the capture's original rate\n"
+            "  -a               Fail if the driver allocates memory after "
+            "the first pass\n"
+            "  -c               Compare the liblo and native decoders\n",
+            name);
+    exit(1);
+}
+
+/**
+ * Brings up a device, replays the capture to it and reports how it went.
+ * The driver's time per datagram is stored in ns, the number of events
+ * it posted in posted_events, and its counters in counters.
+ *
+ * @return 1 if the driver allocated memory after the first pass with -a,
+ * -1 on error, 0 otherwise
+ */
+static int
+_replay(CapturePtr cap, const char *path, double *ns,
+        unsigned long *posted_events, CountersRec *counters)
+{
+    InputInfoRec info;
+    InputInfoPtr pInfo = &info;
+    TuioDevicePtr pTuio;
+    DeviceIntPtr dev;
+    struct sockaddr_in addr;
+    struct sockaddr_un un;
+    uint64_t *latency, *transport, start, elapsed, busy = 0, t;
+    unsigned long wakeups = 0, events, total, traced = 0;
+    unsigned long allocs, steady_allocs = 0, steady_wakeups = 0;
+    StubTraceRec posted, actual;
+    int sock[CAPTURE_MAX_SENDERS];
+    int r, i, j;
+
+    memset(&stub_stats, 0, sizeof(stub_stats));
+
+    /* Bring the device up the way the server would */
+    memset(&info, 0, sizeof(info));
+    info.name = "tuio-replay";
+    info.fd = -1;
+    TUIO.PreInit(&TUIO, pInfo, 0);
+    pTuio = pInfo->private;
+    if (pTuio == NULL)
+        return -1;
+    if (cap->num_unix_senders > 0 && pTuio->socket_path == NULL)
+        fprintf(stderr, "%s: Replaying %i senders of a Unix socket over "
+                "UDP\n", path, cap->num_unix_senders);
+    dev = StubDeviceNew(pInfo);
+    if (dev == NULL ||
+        pInfo->device_control(dev, DEVICE_INIT) != Success ||
+        pInfo->device_control(dev, DEVICE_ON) != Success)
+        return -1;
+
+    /* The driver tells senders apart by address, so keep them apart.
+     * Unix senders are bound to distinct abstract names by the kernel. */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(pTuio->tuio_port);
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    if (pTuio->socket_path != NULL)
+        strncpy(un.sun_path, pTuio->socket_path, sizeof(un.sun_path) - 1);
+    for (i = 0; i < cap->num_senders; i++) {
+        if (pTuio->socket_path != NULL) {
+            sock[i] = socket(AF_UNIX, SOCK_DGRAM, 0);
+            if (sock[i] < 0 ||
+                bind(sock[i], (struct sockaddr *)&un,
+                     sizeof(sa_family_t)) < 0 ||
+                connect(sock[i], (struct sockaddr *)&un, sizeof(un)) < 0) {
+                perror("socket");
+                return -1;
+            }
+        } else {
+            sock[i] = socket(AF_INET, SOCK_DGRAM, 0);
+            if (sock[i] < 0 || connect(sock[i], (struct sockaddr *)&addr,
+                                       sizeof(addr)) < 0) {
+                perror("socket");
+                return -1;
+            }
+        }
+    }
+
+    latency = malloc(((cap->num_packets + batch - 1) / batch) * repeat *
+                     sizeof(uint64_t));
+    transport = malloc(((cap->num_packets + batch - 1) / batch) * repeat *
+                       sizeof(uint64_t));
+    if (latency == NULL || transport == NULL)
+        return -1;
+
+    memset(&posted, 0, sizeof(posted));
+    memset(&actual, 0, sizeof(actual));
+    if (pTuio->predict_horizon)
+        stub_trace = &posted;
+
+    start = _now();
+    for (r = 0; r < repeat; r++) {
+        uint64_t base = _now();
+
+        for (i = 0; i < cap->num_packets; i += batch) {
+            if (realtime) {
+                /* Spin rather than sleep, to keep the original spacing */
+                while (_now() - base < cap->packets[i].time)
+                    ;
+            }
+
+            allocs = __atomic_load_n(&stub_allocs, __ATOMIC_RELAXED);
+            t = _now();
+            for (j = i; j < i + batch && j < cap->num_packets; j++)
+                send(sock[cap->packets[j].sender], cap->packets[j].data,
+                     cap->packets[j].len, 0);
+
+            /* Loopback delivers synchronously, but don't time an empty
+             * wakeup if it didn't */
+            xf86WaitForInput(pInfo->fd, 1000000);
+            transport[wakeups] = _now() - t;
+
+            t = _now();
+            pInfo->read_input(pInfo);
+            latency[wakeups] = _now() - t;
+            busy += latency[wakeups++];
+
+            if (check_allocs && r > 0) {
+                allocs = __atomic_load_n(&stub_allocs, __ATOMIC_RELAXED) -
+                    allocs;
+                if (allocs > 0 && steady_allocs == 0)
+                    fprintf(stderr, "Wakeup %lu allocated memory %lu "
+                            "times\n", wakeups, allocs);
+                steady_allocs += allocs;
+                steady_wakeups++;
+            }
+
+            if (stub_trace != NULL)
+                _trace_wakeup(pTuio, &posted, &traced, &actual, t - start);
+        }
+    }
+    elapsed = _now() - start;
+
+    /* With Option "Threaded", events may still be on their way */
+    while (xf86WaitForInput(pInfo->fd, 100000) > 0)
+        pInfo->read_input(pInfo);
+    if (stub_trace != NULL)
+        _trace_wakeup(pTuio, &posted, &traced, &actual, _now() - start);
+
+    pInfo->device_control(dev, DEVICE_OFF);
+
+    qsort(latency, wakeups, sizeof(uint64_t), _compare_u64);
+    qsort(transport, wakeups, sizeof(uint64_t), _compare_u64);
+    events = stub_stats.touch_begin + stub_stats.touch_update +
+             stub_stats.touch_end;
+
+    printf("%lu datagrams received of %lu sent by %i senders, "
+           "in %lu wakeups, %lu dropped by the kernel\n",
+           pTuio->counters.packets, (unsigned long)cap->num_packets * repeat,
+           cap->num_senders, wakeups, pTuio->counters.dropped);
+    printf("%lu touch events (%lu begin, %lu update, %lu end)\n",
+           events, stub_stats.touch_begin, stub_stats.touch_update,
+           stub_stats.touch_end);
+    printf("%.3f s total, %.3f s in the driver\n",
+           elapsed / 1e9, busy / 1e9);
+    printf("%.0f events/s, %.0f ns/datagram\n",
+           busy ? events * 1e9 / busy : 0.0,
+           pTuio->counters.packets ?
+               (double)busy / pTuio->counters.packets : 0.0);
+    printf("wakeup latency p50 %llu ns, p99 %llu ns, p999 %llu ns, "
+           "max %llu ns\n",
+           (unsigned long long)latency[wakeups / 2],
+           (unsigned long long)latency[wakeups * 99 / 100],
+           (unsigned long long)latency[wakeups * 999 / 1000],
+           (unsigned long long)latency[wakeups - 1]);
+    printf("transport latency p50 %llu ns, p99 %llu ns, p999 %llu ns, "
+           "max %llu ns\n",
+           (unsigned long long)transport[wakeups / 2],
+           (unsigned long long)transport[wakeups * 99 / 100],
+           (unsigned long long)transport[wakeups * 999 / 1000],
+           (unsigned long long)transport[wakeups - 1]);
+    printf("driver decode latency p50 %llu ns, p99 %llu ns, "
+           "frame latency p50 %llu ns, p99 %llu ns\n",
+           TuioHistogramPercentile(&pTuio->decode_latency, 0.5, &total),
+           TuioHistogramPercentile(&pTuio->decode_latency, 0.99, &total),
+           TuioHistogramPercentile(&pTuio->frame_latency, 0.5, &total),
+           TuioHistogramPercentile(&pTuio->frame_latency, 0.99, &total));
+    printf("%lu datagrams applied, %lu stale frames, %lu malformed, "
+           "%lu objects overflowed, %lu updates suppressed\n",
+           pTuio->counters.bundles, pTuio->counters.stale,
+           pTuio->counters.malformed, pTuio->counters.overflow,
+           pTuio->counters.suppressed);
+    if (stub_trace != NULL)
+        _report_prediction(&posted, &actual, pTuio->predict_horizon);
+    if (check_allocs)
+        printf("%lu allocations in %lu wakeups after the first pass\n",
+               steady_allocs, steady_wakeups);
+    *ns = pTuio->counters.packets ?
+        (double)busy / pTuio->counters.packets : 0.0;
+    *posted_events = events;
+    *counters = pTuio->counters;
+
+    pInfo->device_control(dev, DEVICE_CLOSE);
+    StubDeviceFree(dev);
+    free(latency);
+    free(transport);
+    stub_trace = NULL;
+    StubTraceFree(&posted);
+    StubTraceFree(&actual);
+    for (i = 0; i < cap->num_senders; i++)
+        close(sock[i]);
+
+    return steady_allocs > 0;
+}
+
+/**
+ * Prints the counters that the decoders disagree on.  Datagrams dropped
+ * and contacts expired depend on timing, and aren't compared.
+ *
+ * @return the number of counters that differ
+ */
+static int
+_compare_counters(const CountersRec *lo, const CountersRec *native)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } compared[] = {
+        { "datagrams applied", offsetof(CountersRec, bundles) },
+        { "stale frames", offsetof(CountersRec, stale) },
+        { "malformed", offsetof(CountersRec, malformed) },
+        { "touches begun", offsetof(CountersRec, born) },
+        { "touches ended", offsetof(CountersRec, died) },
+        { "objects without a subdevice", offsetof(CountersRec, no_subdev) },
+        { "objects overflowed", offsetof(CountersRec, overflow) },
+        { "updates suppressed", offsetof(CountersRec, suppressed) },
+    };
+    unsigned long a, b;
+    unsigned int i;
+    int differ = 0;
+
+    for (i = 0; i < sizeof(compared) / sizeof(compared[0]); i++) {
+        a = *(const unsigned long *)((const char *)lo + compared[i].offset);
+        b = *(const unsigned long *)((const char *)native +
+                                     compared[i].offset);
+        if (a != b) {
+            printf("The decoders disagree on %s: %lu with liblo, %lu "
+                   "native\n", compared[i].name, a, b);
+            differ++;
+        }
+    }
+
+    return differ;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *decoders[] = { "liblo", "native" };
+    CaptureRec cap;
+    char option[32];
+    double ns[2];
+    unsigned long events[2];
+    CountersRec counters[2];
+    int port = 0, compare = 0, failed = 0;
+    int opt, status, i;
+
+    while ((opt = getopt(argc, argv, "o:b:n:p:rac")) != -1) {
+        switch (opt) {
+            case 'o':
+                if (StubSetOption(optarg) < 0)
+                    _usage(argv[0]);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'n':
+                repeat = atoi(optarg);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'r':
+                realtime = 1;
+                break;
+            case 'a':
+                check_allocs = 1;
+                break;
+            case 'c':
+                compare = 1;
+                break;
+            default:
+                _usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || batch < 1 || repeat < 1)
+        _usage(argv[0]);
+#ifndef __GLIBC__
+    if (check_allocs) {
+        fprintf(stderr, "%s: -a needs glibc\n", argv[0]);
+        return 1;
+    }
+#endif
+    if (check_allocs && repeat < 2)
+        repeat = 2;
+
+    if (CaptureLoad(&cap, argv[optind], port) < 0)
+        return 1;
+    if (cap.num_packets == 0) {
+        fprintf(stderr, "%s: No UDP datagrams found\n", argv[optind]);
+        return 1;
+    }
+
+    if (!compare) {
+        status = _replay(&cap, argv[optind], &ns[0], &events[0],
+                         &counters[0]);
+        CaptureFree(&cap);
+        return status != 0;
+    }
+
+    /* The same datagrams through each decoder in turn, later options
+     * taking precedence */
+    for (i = 0; i < 2; i++) {
+        snprintf(option, sizeof(option), "Decoder=%s", decoders[i]);
+        StubSetOption(option);
+        printf("Decoder \"%s\":\n", decoders[i]);
+        status = _replay(&cap, argv[optind], &ns[i], &events[i],
+                         &counters[i]);
+        if (status < 0)
+            break;
+        failed |= status;
+        printf("\n");
+    }
+    CaptureFree(&cap);
+    if (status < 0)
+        return 1;
+
+    printf("native decoder %.0f ns/datagram, liblo %.0f ns/datagram, "
+           "%.2f times as fast\n", ns[1], ns[0], ns[1] ? ns[0] / ns[1] : 0.0);
+    if (events[0] != events[1]) {
+        printf("The decoders posted different numbers of events\n");
+        failed = 1;
+    }
+    if (_compare_counters(&counters[0], &counters[1]) > 0)
+        failed = 1;
+    return failed;
+}
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Stand-ins for the X server functions that the driver calls.  Events are
+ * counted and optionally traced, options come from the command line, and device
+ * classes are accepted without being set up.  With glibc, calls to the
+ * allocator are counted as well, by wrapping glibc's own.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include <xf86Xinput.h>
+#include <exevents.h>
+#include <xserver-properties.h>
+
+#include "stubs.h"
+
+#define MAX_OPTIONS 64
+#define MAX_VALUATORS 36
+
+StubStatsRec stub_stats;
+StubTracePtr stub_trace;
+unsigned long stub_allocs;
+
+/* Set while the stand-ins allocate for themselves.  volatile, as the
+ * compiler assumes the allocator doesn't look at it. */
+static __thread volatile int uncounted;
+
+static struct {
+    char *name;
+    char *value;
+} options[MAX_OPTIONS];
+static int num_options;
+
+/* Stands in for the server's ValuatorMask */
+typedef struct _StubMask {
+    unsigned char mask[(MAX_VALUATORS + 7) / 8];
+    int valuators[MAX_VALUATORS];
+} StubMaskRec, *StubMaskPtr;
+
+/**
+ * Adds an option given as Name=Value, as if it was in the device's
+ * InputClass section
+ *
+ * @return -1 if the option isn't in that form, or there are too many
+ */
+int
+StubSetOption(const char *option)
+{
+    const char *eq = strchr(option, '=');
+
+    if (eq == NULL || num_options == MAX_OPTIONS)
+        return -1;
+
+    options[num_options].name = strndup(option, eq - option);
+    options[num_options].value = strdup(eq + 1);
+    num_options++;
+    return 0;
+}
+
+static const char *
+_option_value(const char *name)
+{
+    int i;
+
+    for (i = num_options - 1; i >= 0; i--) {
+        if (strcasecmp(options[i].name, name) == 0)
+            return options[i].value;
+    }
+    return NULL;
+}
+
+/**
+ * Allocates a device for pInfo, as the server does before DEVICE_INIT
+ */
+DeviceIntPtr
+StubDeviceNew(InputInfoPtr pInfo)
+{
+    DeviceIntPtr dev = calloc(1, sizeof(DeviceIntRec));
+
+    if (dev == NULL)
+        return NULL;
+
+    dev->public.devicePrivate = pInfo;
+    pInfo->dev = dev;
+    return dev;
+}
+
+void
+StubDeviceFree(DeviceIntPtr dev)
+{
+    free(dev);
+}
+
+/* Memory allocation */
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+    if (!uncounted)
+        __atomic_fetch_add(&stub_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    if (!uncounted)
+        __atomic_fetch_add(&stub_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    if (!uncounted)
+        __atomic_fetch_add(&stub_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/* Logging */
+
+void
+xf86Msg(MessageType type, const char *format, ...)
+{
+    va_list args;
+
+    if (type != X_ERROR && type != X_WARNING && getenv("TUIO_VERBOSE") == NULL)
+        return;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/* Options */
+
+int
+xf86SetIntOption(XF86OptionPtr optlist, const char *name, int deflt)
+{
+    const char *value = _option_value(name);
+
+    return value ? atoi(value) : deflt;
+}
+
+int
+xf86SetBoolOption(XF86OptionPtr optlist, const char *name, int deflt)
+{
+    const char *value = _option_value(name);
+
+    if (value == NULL)
+        return deflt;
+    return strcasecmp(value, "on") == 0 || strcasecmp(value, "true") == 0 ||
+           strcasecmp(value, "yes") == 0 || strcmp(value, "1") == 0;
+}
+
+double
+xf86SetRealOption(XF86OptionPtr optlist, const char *name, double deflt)
+{
+    const char *value = _option_value(name);
+
+    return value ? atof(value) : deflt;
+}
+
+char *
+xf86SetStrOption(XF86OptionPtr optlist, const char *name, const char *deflt)
+{
+    const char *value = _option_value(name);
+
+    if (value == NULL)
+        value = deflt;
+    return value ? strdup(value) : NULL;
+}
+
+char *
+xf86CheckStrOption(XF86OptionPtr optlist, const char *name, const char *deflt)
+{
+    return xf86SetStrOption(optlist, name, deflt);
+}
+
+void
+xf86CollectInputOptions(InputInfoPtr pInfo, const char **defaultOpts)
+{
+}
+
+void
+xf86ProcessCommonOptions(InputInfoPtr pInfo, XF86OptionPtr list)
+{
+}
+
+/* Driver and device registration */
+
+void
+xf86AddInputDriver(InputDriverPtr driver, pointer module, int flags)
+{
+}
+
+void
+xf86DeleteInput(InputInfoPtr pInp, int flags)
+{
+}
+
+void
+xf86AddEnabledDevice(InputInfoPtr pInfo)
+{
+}
+
+void
+xf86RemoveEnabledDevice(InputInfoPtr pInfo)
+{
+}
+
+/* Input */
+
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 23
+void
+input_lock(void)
+{
+}
+
+void
+input_unlock(void)
+{
+}
+#else
+int
+xf86BlockSIGIO(void)
+{
+    return 0;
+}
+
+void
+xf86UnblockSIGIO(int wasset)
+{
+}
+#endif
+
+int
+xf86WaitForInput(int fd, int timeout)
+{
+    struct timeval to;
+    fd_set readfds;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    to.tv_sec = timeout / 1000000;
+    to.tv_usec = timeout % 1000000;
+
+    return select(fd + 1, &readfds, NULL, NULL, timeout >= 0 ? &to : NULL);
+}
+
+void
+xf86FlushInput(int fd)
+{
+    char buf[256];
+
+    while (xf86WaitForInput(fd, 0) > 0) {
+        if (read(fd, buf, sizeof(buf)) < 1)
+            break;
+    }
+}
+
+/* Timers, which never fire.  Nothing is rebound during a replay. */
+
+OsTimerPtr
+TimerSet(OsTimerPtr timer, int flags, CARD32 millis, OsTimerCallback func,
+         pointer arg)
+{
+    return timer;
+}
+
+void
+TimerCancel(OsTimerPtr timer)
+{
+}
+
+void
+TimerFree(OsTimerPtr timer)
+{
+}
+
+/* Device classes */
+
+Bool
+InitValuatorClassDeviceStruct(DeviceIntPtr dev, int numAxes, Atom *labels,
+                              int numMotionEvents, int mode)
+{
+    return numAxes <= MAX_VALUATORS;
+}
+
+Bool
+xf86InitValuatorAxisStruct(DeviceIntPtr dev, int axnum, Atom label,
+                           int minval, int maxval, int resolution,
+                           int min_res, int max_res, int mode)
+{
+    return TRUE;
+}
+
+void
+xf86InitValuatorDefaults(DeviceIntPtr dev, int axnum)
+{
+}
+
+Bool
+InitAbsoluteClassDeviceStruct(DeviceIntPtr device)
+{
+    return TRUE;
+}
+
+Bool
+InitTouchClassDeviceStruct(DeviceIntPtr device, unsigned int max_touches,
+                           unsigned int mode, unsigned int num_axes)
+{
+    return TRUE;
+}
+
+Bool
+InitButtonClassDeviceStruct(DeviceIntPtr dev, int numButtons, Atom *labels,
+                            CARD8 *map)
+{
+    return TRUE;
+}
+
+int
+GetMotionHistorySize(void)
+{
+    return 0;
+}
+
+Atom
+XIGetKnownProperty(const char *name)
+{
+    return MakeAtom(name, strlen(name), TRUE);
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    static Atom next_atom = 1;
+
+    return next_atom++;
+}
+
+/* Properties, which are only accepted */
+
+int
+XIChangeDeviceProperty(DeviceIntPtr dev, Atom property, Atom type,
+                       int format, int mode, unsigned long len,
+                       const void *value, Bool sendevent)
+{
+    return Success;
+}
+
+int
+XISetDevicePropertyDeletable(DeviceIntPtr dev, Atom property, Bool deletable)
+{
+    return Success;
+}
+
+long
+XIRegisterPropertyHandler(DeviceIntPtr dev,
+                          int (*SetProperty) (DeviceIntPtr dev, Atom property,
+                                              XIPropertyValuePtr prop,
+                                              BOOL checkonly),
+                          int (*GetProperty) (DeviceIntPtr dev, Atom property),
+                          int (*DeleteProperty) (DeviceIntPtr dev,
+                                                 Atom property))
+{
+    return 1;
+}
+
+/* Valuator masks */
+
+ValuatorMask *
+valuator_mask_new(int num_valuators)
+{
+    return (ValuatorMask *)calloc(1, sizeof(StubMaskRec));
+}
+
+void
+valuator_mask_free(ValuatorMask **mask)
+{
+    free(*mask);
+    *mask = NULL;
+}
+
+void
+valuator_mask_zero(ValuatorMask *mask)
+{
+    memset(mask, 0, sizeof(StubMaskRec));
+}
+
+void
+valuator_mask_set(ValuatorMask *mask, int valuator, int data)
+{
+    StubMaskPtr m = (StubMaskPtr)mask;
+
+    m->mask[valuator / 8] |= 1 << (valuator % 8);
+    m->valuators[valuator] = data;
+}
+
+Bool
+valuator_mask_isset(const ValuatorMask *mask, int valuator)
+{
+    const StubMaskRec *m = (const StubMaskRec *)mask;
+
+    return (m->mask[valuator / 8] >> (valuator % 8)) & 1;
+}
+
+int
+valuator_mask_get(const ValuatorMask *mask, int valuator)
+{
+    const StubMaskRec *m = (const StubMaskRec *)mask;
+
+    return m->valuators[valuator];
+}
+
+void
+valuator_mask_set_range(ValuatorMask *mask, int first_valuator,
+                        int num_valuators, const int *valuators)
+{
+    int i;
+
+    for (i = 0; i < num_valuators; i++)
+        valuator_mask_set(mask, first_valuator + i, valuators[i]);
+}
+
+/* Events */
+
+/**
+ * Adds a position to a trace, exits if out of memory
+ */
+void
+StubTraceAdd(StubTracePtr trace, unsigned int touch_id, double x, double y,
+             uint64_t time)
+{
+    StubTouchPtr touch;
+
+    if (trace->num_touches == trace->size) {
+        trace->size = trace->size ? trace->size * 2 : 4096;
+        uncounted++;
+        trace->touches = realloc(trace->touches,
+                                 trace->size * sizeof(StubTouchRec));
+        uncounted--;
+        if (trace->touches == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    touch = &trace->touches[trace->num_touches++];
+    touch->touch_id = touch_id;
+    touch->x = x;
+    touch->y = y;
+    touch->time = time;
+}
+
+void
+StubTraceFree(StubTracePtr trace)
+{
+    free(trace->touches);
+    memset(trace, 0, sizeof(*trace));
+}
+
+void
+xf86PostTouchEvent(DeviceIntPtr dev, uint32_t touchid, uint16_t type,
+                   uint32_t flags, const ValuatorMask *mask)
+{
+    const StubMaskRec *m = (const StubMaskRec *)mask;
+
+    if (stub_trace != NULL)
+        StubTraceAdd(stub_trace, touchid, m->valuators[0] / (double)0x7FFFFFFF,
+                     m->valuators[1] / (double)0x7FFFFFFF, 0);
+
+    switch (type) {
+        case XI_TouchBegin:
+            stub_stats.touch_begin++;
+            break;
+        case XI_TouchUpdate:
+            stub_stats.touch_update++;
+            break;
+        case XI_TouchEnd:
+            stub_stats.touch_end++;
+            break;
+    }
+}
+
+void
+xf86PostButtonEvent(DeviceIntPtr device, int is_absolute, int button,
+                    int is_down, int first_valuator, int num_valuators, ...)
+{
+    stub_stats.buttons++;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * Stand-ins for the parts of the X server used by the driver, so that it
+ * can be run outside of Xorg by the tools
+ */
+
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <xf86Xinput.h>
+
+/* Touch events posted through xf86PostTouchEvent(), by type */
+typedef struct _StubStats {
+    unsigned long touch_begin;
+    unsigned long touch_update;
+    unsigned long touch_end;
+    unsigned long buttons;
+} StubStatsRec;
+
+extern StubStatsRec stub_stats;
+
+/* Positions of touches over time */
+typedef struct _StubTouch {
+    unsigned int touch_id;
+    double x, y; /* As a fraction of the device */
+    uint64_t time;
+} StubTouchRec, *StubTouchPtr;
+
+typedef struct _StubTrace {
+    StubTouchPtr touches;
+    unsigned long num_touches;
+    unsigned long size;
+} StubTraceRec, *StubTracePtr;
+
+/* If set, the positions posted by xf86PostTouchEvent() are added here,
+ * with a time of 0 */
+extern StubTracePtr stub_trace;
+
+/* Calls to malloc(), calloc() and realloc() by any thread, other than
+ * the stand-ins' own.  Only counted with glibc. */
+extern unsigned long stub_allocs;
+
+int StubSetOption(const char *option);
+DeviceIntPtr StubDeviceNew(InputInfoPtr pInfo);
+void StubDeviceFree(DeviceIntPtr dev);
+void StubTraceAdd(StubTracePtr trace, unsigned int touch_id, double x,
+                  double y, uint64_t time);
+void StubTraceFree(StubTracePtr trace);
+
+#endif
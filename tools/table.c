@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2009 Ryan Huffman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *	Ryan Huffman (ryanhuffman@gmail.com)
+ *	Andreas Willich (sabotageandi@gmail.com)
+ *	Brady O'Brien (baobrien@evtron.com)
+ */
+
+/*
+ * tuio-table: times the object table against the singly linked list it
+ * replaced, at 10, 100 and 1000 live session ids.  Lookups are done for
+ * every live id in turn, as the "set" messages of a frame would.
+ * Contacts are born and die oldest first, with new ids handed out
+ * sequentially as trackers do, and each add and remove is timed over a
+ * whole round of them.  The cost of reading the clock is taken out of
+ * the times, which matters with few live ids.
+ *
+ * Usage: tuio-table [-n operations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xf86Xinput.h>
+
+#include "tuio.h"
+
+static const int live_counts[] = { 10, 100, 1000 };
+
+/* Keeps the compiler from dropping lookups whose result is unused */
+static volatile int sink;
+
+static uint64_t
+_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @return the time taken by a pair of _now() calls, in ns
+ */
+static uint64_t
+_now_overhead(void)
+{
+    uint64_t t, total = 0;
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        t = _now();
+        total += _now() - t;
+    }
+
+    return total / 100000;
+}
+
+/* The list that held the live objects before, newest first */
+
+static ObjectPtr
+_list_get(ObjectPtr head, int source, int id)
+{
+    ObjectPtr obj = head;
+
+    while (obj != NULL && (obj->id != id || obj->source != source))
+        obj = obj->next;
+
+    return obj;
+}
+
+static void
+_list_add(ObjectPtr *list, ObjectPtr obj)
+{
+    obj->next = *list;
+    *list = obj;
+}
+
+static ObjectPtr
+_list_remove(ObjectPtr *list, ObjectPtr obj)
+{
+    ObjectPtr *link = list;
+
+    while (*link != NULL && *link != obj)
+        link = &(*link)->next;
+    if (*link == NULL)
+        return NULL;
+
+    *link = obj->next;
+    obj->next = NULL;
+    return obj;
+}
+
+/**
+ * Times get, add and remove with live objects in a table, or in a list
+ * if table is NULL.  Each round looks up every live id, then replaces
+ * the oldest half of the objects with new ones.  Times are in ns per
+ * operation.
+ */
+static void
+_bench(ObjectTablePtr table, int live, long ops, uint64_t overhead,
+       double *get, double *add, double *remove)
+{
+    ObjectPtr pool, *order, list = NULL;
+    uint64_t t, get_ns = 0, add_ns = 0, remove_ns = 0;
+    long gets = 0, changes = 0;
+    int next_id = 1, oldest = 0, half = live / 2;
+    int i;
+
+    pool = calloc(live, sizeof(ObjectRec));
+    order = calloc(live, sizeof(ObjectPtr));
+    if (pool == NULL || order == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    /* order is a ring of the live objects, oldest at index oldest */
+    for (i = 0; i < live; i++) {
+        pool[i].id = next_id++;
+        order[i] = &pool[i];
+        if (table != NULL)
+            TuioObjectAdd(table, &pool[i]);
+        else
+            _list_add(&list, &pool[i]);
+    }
+
+    while (gets < ops) {
+        t = _now();
+        for (i = 0; i < live; i++) {
+            int id = next_id - live + i;
+
+            if (table != NULL)
+                sink += TuioObjectGet(table, 0, id)->id;
+            else
+                sink += _list_get(list, 0, id)->id;
+        }
+        get_ns += _now() - t - overhead;
+        gets += live;
+
+        t = _now();
+        for (i = 0; i < half; i++) {
+            ObjectPtr obj = order[(oldest + i) % live];
+
+            if (table != NULL)
+                TuioObjectRemove(table, obj);
+            else
+                _list_remove(&list, obj);
+        }
+        remove_ns += _now() - t - overhead;
+
+        t = _now();
+        for (i = 0; i < half; i++) {
+            ObjectPtr obj = order[(oldest + i) % live];
+
+            obj->id = next_id++;
+            if (table != NULL)
+                TuioObjectAdd(table, obj);
+            else
+                _list_add(&list, obj);
+        }
+        add_ns += _now() - t - overhead;
+        oldest = (oldest + half) % live;
+        changes += half;
+    }
+
+    *get = (double)(int64_t)get_ns / gets;
+    *add = (double)(int64_t)add_ns / changes;
+    *remove = (double)(int64_t)remove_ns / changes;
+
+    free(order);
+    free(pool);
+}
+
+static void
+_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n operations  Lookups timed per size (default 1000000)\n",
+            name);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    ObjectTableRec table;
+    double get[2], add[2], remove[2];
+    uint64_t overhead;
+    long ops = 1000000;
+    unsigned int slots, i;
+    int opt, live;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                ops = atol(optarg);
+                break;
+            default:
+                _usage(argv[0]);
+        }
+    }
+    if (optind != argc || ops < 1)
+        _usage(argv[0]);
+
+    overhead = _now_overhead();
+    printf("%6s %21s %21s %21s\n", "", "get ns", "add ns", "remove ns");
+    printf("%6s %10s %10s %10s %10s %10s %10s\n", "live",
+           "list", "table", "list", "table", "list", "table");
+    for (i = 0; i < sizeof(live_counts) / sizeof(live_counts[0]); i++) {
+        live = live_counts[i];
+
+        /* Sized as the driver sizes it for MaxContacts live */
+        for (slots = 1; slots < (unsigned int)live * 2; slots <<= 1)
+            ;
+        if (!TuioObjectTableInit(&table, slots)) {
+            perror("calloc");
+            return 1;
+        }
+
+        _bench(NULL, live, ops, overhead, &get[0], &add[0], &remove[0]);
+        _bench(&table, live, ops, overhead, &get[1], &add[1], &remove[1]);
+        TuioObjectTableFree(&table);
+
+        printf("%6i %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", live,
+               get[0], get[1], add[0], add[1], remove[0], remove[1]);
+    }
+
+    return 0;
+}